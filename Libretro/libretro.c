@@ -7,6 +7,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 static int clamp(int x, int min, int max) {
 	if (x < min) return min;
@@ -44,7 +45,11 @@ static retro_input_state_t   _input_state_cb;
 static struct RISC *_risc = NULL;
 static struct RISC_SPI *_spi_disk = NULL;
 
-static uint32_t _ms_counter;
+/* Frame rate and CPU speed, from the core options */
+static unsigned _fps = FPS;
+static unsigned _cpu_hz = CPU_HZ;
+static uint64_t _frames;
+static bool _can_dupe;
 
 static int _mouse_x, _mouse_y;
 
@@ -146,9 +151,35 @@ static const struct retro_controller_info ports[] = {
         { 0 },
 };
 
+static const struct retro_variable variables[] = {
+	{ "oberon_ram_disk", "RAM disk on second SPI slot; disabled|enabled" },
+	{ "oberon_fps", "Frame rate (restart); 30|60|50|25" },
+	{ "oberon_cpu_mhz", "CPU speed in MHz (restart); 25|50|100|200|12" },
+	{ NULL, NULL },
+};
+
 void retro_set_environment(retro_environment_t cb) {
 	_environ_cb = cb;
 	_environ_cb(RETRO_ENVIRONMENT_SET_CONTROLLER_INFO, (void*)ports);
+	_environ_cb(RETRO_ENVIRONMENT_SET_VARIABLES, (void*)variables);
+}
+
+static bool _variable_is(const char *key, const char *value)
+{
+	struct retro_variable var = { key, NULL };
+	return _environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var)
+		&& var.value && strcmp(var.value, value) == 0;
+}
+
+static unsigned _variable_uint(const char *key, unsigned dflt)
+{
+	struct retro_variable var = { key, NULL };
+	if (_environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
+		unsigned long n = strtoul(var.value, NULL, 10);
+		if (n > 0)
+			return (unsigned)n;
+	}
+	return dflt;
 }
 
 void retro_set_video_refresh(retro_video_refresh_t cb) {
@@ -185,7 +216,7 @@ void retro_deinit(void)
 void retro_set_controller_port_device(unsigned port, unsigned device) { }
 
 void retro_reset(void) {
-	_ms_counter = 1;
+	_frames = 0;
 	risc_reset(_risc);
 }
 
@@ -214,6 +245,8 @@ bool retro_load_game(const struct retro_game_info *game)
 	}
 
 	risc_set_spi(_risc, 1, _spi_disk);
+	if (_variable_is("oberon_ram_disk", "enabled"))
+		risc_set_spi(_risc, 2, disk_new_ram(NULL));
 	risc_set_serial(_risc, raw_serial_new("/dev/null", "/dev/null"));
 
 	enum retro_pixel_format pf = RETRO_PIXEL_FORMAT_RGB565;
@@ -240,7 +273,12 @@ bool retro_load_game(const struct retro_game_info *game)
 
 	risc_configure_memory(_risc, 1, _framebuffer.width, _framebuffer.height);
 
-	_ms_counter = 1;
+	_fps = _variable_uint("oberon_fps", FPS);
+	_cpu_hz = _variable_uint("oberon_cpu_mhz", CPU_HZ / 1000000) * 1000000;
+	if (!_environ_cb(RETRO_ENVIRONMENT_GET_CAN_DUPE, &_can_dupe))
+		_can_dupe = false;
+
+	_frames = 0;
 	_mouse_x = 0;
 	_mouse_y = _framebuffer.height;
 
@@ -254,7 +292,7 @@ void retro_get_system_av_info(struct retro_system_av_info *info)
 	info->geometry.base_height    =
 	info->geometry.max_height     = _framebuffer.height;
 	info->geometry.aspect_ratio   = 0.0;
-	info->timing.fps              = FPS;
+	info->timing.fps              = _fps;
 	info->timing.sample_rate      = 0;
 }
 
@@ -297,9 +335,9 @@ void retro_run(void)
 	risc_mouse_button(_risc, 3,
 		_input_state_cb(0, RETRO_DEVICE_MOUSE, 0, RETRO_DEVICE_ID_MOUSE_RIGHT));
 
-	risc_set_time(_risc, _ms_counter);
-	_ms_counter += 1000 / FPS;
-	risc_run(_risc, CPU_HZ / FPS);
+	risc_set_time(_risc, 1 + (uint32_t)(_frames * 1000 / _fps));
+	_frames++;
+	risc_run(_risc, (int)(_cpu_hz / _fps));
 
  	struct Damage damage = risc_get_framebuffer_damage(_risc);
 	if (damage.y1 <= damage.y2) {
@@ -325,8 +363,10 @@ void retro_run(void)
 		}
 	}
 
+	/* Let the frontend skip the upload if nothing changed */
+	bool changed = damage.y1 <= damage.y2 || !_can_dupe;
 	_video_cb(
-		_framebuffer.data,
+		changed ? _framebuffer.data : NULL,
 		_framebuffer.width,
 		_framebuffer.height,
 		_framebuffer.width << 1);
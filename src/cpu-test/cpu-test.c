@@ -0,0 +1,215 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Runs risc_single_step in lockstep with the reference model in ref.c
+// and compares registers, flags, H and the memory written after every
+// instruction. Values read from I/O are taken over from the emulator.
+//
+//   cpu-test random [STREAMS [LENGTH [SEED]]]
+//   cpu-test boot DISK-IMAGE [FRAMES]
+
+#include "../risc.c"
+#include "../disk.h"
+#include "ref.h"
+
+#define CODE_WORDS 4096
+#define DATA_BASE  0x40000
+#define DATA_RANGE 0x8000
+#define CPU_HZ     25000000
+#define FPS        60
+
+static struct RISC *risc;
+static struct ref_cpu ref;
+static uint64_t steps;
+
+static uint64_t rng_state;
+
+static uint32_t rnd(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return (uint32_t)(rng_state >> 16);
+}
+
+static void copy_state_to_ref(void) {
+  ref.PC = risc->PC;
+  memcpy(ref.R, risc->R, sizeof(ref.R));
+  ref.H = risc->H;
+  ref.N = risc->N;
+  ref.Z = risc->Z;
+  ref.C = risc->C;
+  ref.V = risc->V;
+  ref.mem_size = risc->mem_size;
+  memcpy(ref.RAM, risc->RAM, risc->mem_size);
+  ref.ROM = risc->ROM;
+}
+
+static void print_state(const char *name, uint32_t PC, const uint32_t *R, uint32_t H,
+                        bool N, bool Z, bool C, bool V) {
+  printf("  %-4s PC=%08X H=%08X N=%d Z=%d C=%d V=%d\n      ", name, PC * 4, H, N, Z, C, V);
+  for (int i = 0; i < 16; i++) {
+    printf("R%-2d=%08X%s", i, R[i], i % 6 == 5 ? "\n      " : " ");
+  }
+  printf("\n");
+}
+
+static void mismatch(uint32_t pc, const char *what) {
+  printf("cpu-test: %s differs after step %llu, PC=%08X IR=%08X\n", what,
+         (unsigned long long)steps, pc * 4, ref.ir);
+  print_state("emu", risc->PC, risc->R, risc->H, risc->N, risc->Z, risc->C, risc->V);
+  print_state("ref", ref.PC, ref.R, ref.H, ref.N, ref.Z, ref.C, ref.V);
+  exit(1);
+}
+
+static void check_memory(uint32_t pc) {
+  if (memcmp(ref.RAM, risc->RAM, risc->mem_size) != 0) {
+    for (uint32_t i = 0; i < risc->mem_size / 4; i++) {
+      if (ref.RAM[i] != risc->RAM[i]) {
+        printf("cpu-test: memory at %08X: emu %08X ref %08X\n", i * 4, risc->RAM[i], ref.RAM[i]);
+        break;
+      }
+    }
+    mismatch(pc, "memory");
+  }
+}
+
+static void step(void) {
+  uint32_t pc = ref.PC;
+  enum ref_event ev = ref_step(&ref);
+  risc_single_step(risc);
+  steps++;
+
+  switch (ev) {
+    case REF_IO_LOAD: {
+      uint32_t a = (ref.ir >> 24) & 15;
+      ref_set_register(&ref, (int)a, risc->R[a]);
+      break;
+    }
+    case REF_IO_STORE: {
+      // The block transfer descriptors make the emulator write RAM.
+      uint32_t offset = ref.R[(ref.ir >> 20) & 15] + (uint32_t)(((int32_t)(ref.ir << 12)) >> 12) - IOStart;
+      if (offset == 52 || offset == 56) {
+        memcpy(ref.RAM, risc->RAM, risc->mem_size);
+      }
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+
+  if (ref.PC != risc->PC) {
+    mismatch(pc, "PC");
+  }
+  if (memcmp(ref.R, risc->R, sizeof(ref.R)) != 0) {
+    mismatch(pc, "registers");
+  }
+  if (ref.H != risc->H) {
+    mismatch(pc, "H");
+  }
+  if (ref.N != risc->N || ref.Z != risc->Z || ref.C != risc->C || ref.V != risc->V) {
+    mismatch(pc, "flags");
+  }
+  if (ref.stored && ref.RAM[ref.store_address / 4] != risc->RAM[ref.store_address / 4]) {
+    mismatch(pc, "stored word");
+  }
+  if ((steps & 0xFFFFF) == 0) {
+    check_memory(pc);
+  }
+}
+
+// Instructions that stay inside the test area: R12 points to data,
+// R13 to the I/O page, R15 to code, and only R0-R11 are written by
+// anything but branch-and-link.
+static uint32_t random_instruction(uint32_t pc) {
+  uint32_t kind = rnd() % 100;
+  if (kind < 60) {
+    uint32_t ir = rnd() & 0x7F0FFFFF;  // p=0, any q/u/v, op and operand
+    uint32_t a = rnd() % 12;
+    return (ir & ~0x0F000000U) | a << 24;
+  } else if (kind < 85) {
+    bool store = rnd() & 1;
+    bool io = rnd() % 20 == 0;
+    uint32_t a = store ? rnd() % 16 : rnd() % 12;
+    uint32_t b = io ? 13 : 12;
+    uint32_t off = io ? rnd() % 64 : (rnd() % (2 * DATA_RANGE)) - DATA_RANGE;
+    return 0x80000000 | (uint32_t)store << 29 | (rnd() & 1) << 28 | a << 24 | b << 20 | (off & 0xFFFFF);
+  } else {
+    uint32_t cond = rnd() % 16;
+    uint32_t link = rnd() & 1;
+    if (rnd() % 4 == 0) {
+      return 0xC0000000 | link << 28 | cond << 24 | 15;
+    }
+    uint32_t target = rnd() % CODE_WORDS;
+    return 0xE0000000 | link << 28 | cond << 24 | ((target - pc - 1) & 0xFFFFFF);
+  }
+}
+
+static void random_streams(int streams, int length, uint64_t seed) {
+  rng_state = seed * 0x9E3779B97F4A7C15ULL + 1;
+  for (int s = 0; s < streams; s++) {
+    memset(risc->RAM, 0, risc->mem_size);
+    for (uint32_t i = 0; i < CODE_WORDS - 1; i++) {
+      risc->RAM[i] = random_instruction(i);
+    }
+    risc->RAM[CODE_WORDS - 1] = 0xE7000000 | (-CODE_WORDS & 0xFFFFFF);  // B 0
+    for (uint32_t i = 0; i < DATA_RANGE / 2; i++) {
+      risc->RAM[(DATA_BASE - DATA_RANGE) / 4 + i] = rnd() ^ rnd() << 16;
+    }
+    for (int i = 0; i < 12; i++) {
+      risc->R[i] = rnd() % 4 == 0 ? rnd() % 64 : rnd() ^ rnd() << 16;
+    }
+    risc->R[12] = DATA_BASE + rnd() % 256 * 4;
+    risc->R[13] = IOStart;
+    risc->R[14] = 0;
+    risc->R[15] = rnd() % CODE_WORDS * 4;
+    risc->H = rnd();
+    risc->PC = 0;
+    risc->N = rnd() & 1;
+    risc->Z = rnd() & 1;
+    risc->C = rnd() & 1;
+    risc->V = rnd() & 1;
+    copy_state_to_ref();
+    for (int i = 0; i < length; i++) {
+      step();
+    }
+    check_memory(ref.PC);
+  }
+  printf("cpu-test: %d random streams, %llu instructions, no differences\n",
+         streams, (unsigned long long)steps);
+}
+
+static void boot(const char *disk, int frames) {
+  risc_set_spi(risc, 1, disk_new(disk));
+  copy_state_to_ref();
+  for (int f = 0; f < frames; f++) {
+    risc_set_time(risc, (uint32_t)f * 1000 / FPS);
+    risc->progress = 20;
+    for (int i = 0; i < CPU_HZ / FPS && risc->progress; i++) {
+      step();
+    }
+  }
+  check_memory(ref.PC);
+  printf("cpu-test: booted for %d frames, %llu instructions, no differences\n",
+         frames, (unsigned long long)steps);
+}
+
+int main(int argc, char *argv[]) {
+  risc = risc_new();
+  ref.RAM = malloc(risc->mem_size);
+  if (argc >= 2 && strcmp(argv[1], "random") == 0 && argc <= 5) {
+    random_streams(argc > 2 ? atoi(argv[2]) : 1000,
+                   argc > 3 ? atoi(argv[3]) : 100000,
+                   argc > 4 ? strtoull(argv[4], NULL, 0) : 1);
+  } else if (argc >= 3 && strcmp(argv[1], "boot") == 0 && argc <= 4) {
+    boot(argv[2], argc > 3 ? atoi(argv[3]) : 300);
+  } else {
+    fprintf(stderr, "Usage: cpu-test random [STREAMS [LENGTH [SEED]]]\n"
+                    "       cpu-test boot DISK-IMAGE [FRAMES]\n");
+    return 2;
+  }
+  return 0;
+}
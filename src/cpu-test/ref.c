@@ -0,0 +1,165 @@
+#include "ref.h"
+#include "../risc-fp.h"
+
+// Written from the RISC5 instruction set description (Wirth, "The
+// RISC Architecture", 2015) rather than from risc.c. The memory map
+// and the reset on a jump outside RAM and ROM follow the emulator.
+//
+// DIV, FAD, FSB, FML and FDV are not modelled: they call the emulator's
+// own idiv, fp_add, fp_mul and fp_div, so the lockstep test only checks
+// how those instructions select operands and write results back. The
+// arithmetic itself is out of scope here. fp-test checks it against
+// the Verilog.
+
+#define ROM_START 0x3FFFFE00  // word address of 0xFFFFF800
+#define ROM_WORDS 512
+
+static uint32_t bits(uint32_t ir, int hi, int lo) {
+  return (ir >> lo) & ((1U << (hi - lo + 1)) - 1);
+}
+
+static int32_t sign_extend(uint32_t value, int width) {
+  uint32_t m = 1U << (width - 1);
+  return (int32_t)((value ^ m) - m);
+}
+
+void ref_set_register(struct ref_cpu *cpu, int reg, uint32_t value) {
+  cpu->R[reg] = value;
+  cpu->N = (value >> 31) != 0;
+  cpu->Z = value == 0;
+}
+
+static uint32_t alu(struct ref_cpu *cpu, uint32_t ir, uint32_t b, uint32_t c) {
+  bool u = bits(ir, 29, 29), v = bits(ir, 28, 28), q = bits(ir, 30, 30);
+  switch (bits(ir, 19, 16)) {
+    case 0:  // MOV
+      if (!u) return c;
+      if (q) return c << 16;
+      if (v) return (uint32_t)cpu->N << 31 | (uint32_t)cpu->Z << 30 |
+                    (uint32_t)cpu->C << 29 | (uint32_t)cpu->V << 28 | 0xD0;
+      return cpu->H;
+    case 1: return b << (c % 32);  // LSL
+    case 2: {  // ASR
+      uint32_t n = c % 32;
+      return n == 0 ? b : (b >> n) | ((b >> 31) ? ~0U << (32 - n) : 0);
+    }
+    case 3: {  // ROR
+      uint32_t n = c % 32;
+      return n == 0 ? b : (b >> n) | (b << (32 - n));
+    }
+    case 4: return b & c;   // AND
+    case 5: return b & ~c;  // ANN
+    case 6: return b | c;   // IOR
+    case 7: return b ^ c;   // XOR
+    case 8: {  // ADD, ADC
+      uint64_t sum = (uint64_t)b + c + (u && cpu->C);
+      uint32_t r = (uint32_t)sum;
+      cpu->C = (sum >> 32) != 0;
+      cpu->V = ((b >> 31) == (c >> 31)) && ((r >> 31) != (b >> 31));
+      return r;
+    }
+    case 9: {  // SUB, SBC
+      uint64_t diff = (uint64_t)b - c - (u && cpu->C);
+      uint32_t r = (uint32_t)diff;
+      cpu->C = (diff >> 32) != 0;
+      cpu->V = ((b >> 31) != (c >> 31)) && ((r >> 31) != (b >> 31));
+      return r;
+    }
+    case 10: {  // MUL
+      uint64_t p;
+      if (u) {
+        p = (uint64_t)b * c;
+      } else {
+        p = (uint64_t)((int64_t)(int32_t)b * (int64_t)(int32_t)c);
+      }
+      cpu->H = (uint32_t)(p >> 32);
+      return (uint32_t)p;
+    }
+    case 11: {  // DIV, through the emulator's divider (u means unsigned)
+      struct idiv d = idiv(b, c, !u);
+      cpu->H = d.rem;
+      return d.quot;
+    }
+    case 12: return fp_add(b, c, u, v);               // FAD
+    case 13: return fp_add(b, c ^ 0x80000000, u, v);  // FSB
+    case 14: return fp_mul(b, c);                     // FML
+    default: return fp_div(b, c);                     // FDV
+  }
+}
+
+static bool condition(struct ref_cpu *cpu, uint32_t cond) {
+  bool t;
+  switch (cond & 7) {
+    case 0: t = cpu->N; break;                          // MI
+    case 1: t = cpu->Z; break;                          // EQ
+    case 2: t = cpu->C; break;                          // CS
+    case 3: t = cpu->V; break;                          // VS
+    case 4: t = cpu->C || cpu->Z; break;                // LS
+    case 5: t = cpu->N != cpu->V; break;                // LT
+    case 6: t = (cpu->N != cpu->V) || cpu->Z; break;    // LE
+    default: t = true; break;                           // T
+  }
+  return (cond & 8) ? !t : t;
+}
+
+enum ref_event ref_step(struct ref_cpu *cpu) {
+  cpu->stored = false;
+  uint32_t ir;
+  if (cpu->PC < cpu->mem_size / 4) {
+    ir = cpu->RAM[cpu->PC];
+  } else if (cpu->PC >= ROM_START && cpu->PC < ROM_START + ROM_WORDS) {
+    ir = cpu->ROM[cpu->PC - ROM_START];
+  } else {
+    cpu->PC = ROM_START;
+    return REF_RESET;
+  }
+  cpu->ir = ir;
+  cpu->PC++;
+
+  uint32_t a = bits(ir, 27, 24), b = bits(ir, 23, 20);
+  if (!bits(ir, 31, 31)) {
+    uint32_t c;
+    if (!bits(ir, 30, 30)) {
+      c = cpu->R[bits(ir, 3, 0)];
+    } else {
+      c = bits(ir, 15, 0) | (bits(ir, 28, 28) ? 0xFFFF0000 : 0);
+    }
+    ref_set_register(cpu, (int)a, alu(cpu, ir, cpu->R[b], c));
+    return REF_NONE;
+  }
+
+  if (!bits(ir, 30, 30)) {
+    uint32_t address = cpu->R[b] + (uint32_t)sign_extend(bits(ir, 19, 0), 20);
+    bool byte = bits(ir, 28, 28);
+    if (address >= cpu->mem_size) {
+      return bits(ir, 29, 29) ? REF_IO_STORE : REF_IO_LOAD;
+    }
+    uint32_t *word = &cpu->RAM[address / 4];
+    int shift = (int)(address % 4) * 8;
+    if (!bits(ir, 29, 29)) {
+      ref_set_register(cpu, (int)a, byte ? (*word >> shift) & 0xFF : *word);
+    } else {
+      if (byte) {
+        *word = (*word & ~(0xFFU << shift)) | (cpu->R[a] & 0xFF) << shift;
+      } else {
+        *word = cpu->R[a];
+      }
+      cpu->stored = true;
+      cpu->store_address = address & ~3U;
+    }
+    return REF_NONE;
+  }
+
+  if (condition(cpu, bits(ir, 27, 24))) {
+    uint32_t link = cpu->PC * 4;
+    if (bits(ir, 29, 29)) {
+      cpu->PC += (uint32_t)sign_extend(bits(ir, 23, 0), 24);
+    } else {
+      cpu->PC = cpu->R[bits(ir, 3, 0)] / 4;
+    }
+    if (bits(ir, 28, 28)) {
+      ref_set_register(cpu, 15, link);
+    }
+  }
+  return REF_NONE;
+}
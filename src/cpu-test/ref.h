@@ -0,0 +1,37 @@
+#ifndef REF_H
+#define REF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// A deliberately plain model of the RISC5 processor, used as the
+// reference in cpu-test. It shares nothing with risc.c except the FP
+// and divider units, which fp-test checks against the Verilog.
+
+struct ref_cpu {
+  uint32_t PC;  // word address
+  uint32_t R[16];
+  uint32_t H;
+  bool N, Z, C, V;
+
+  uint32_t mem_size;  // bytes; everything above is I/O
+  uint32_t *RAM;
+  const uint32_t *ROM;
+
+  // Set by ref_step for the instruction just executed
+  uint32_t ir;
+  bool stored;            // a RAM word was written
+  uint32_t store_address;
+};
+
+enum ref_event {
+  REF_NONE,
+  REF_IO_LOAD,   // the loaded value is unknown, R[ir.a] must be synced
+  REF_IO_STORE,  // a device was written
+  REF_RESET      // PC left memory, the emulator resets
+};
+
+enum ref_event ref_step(struct ref_cpu *cpu);
+void ref_set_register(struct ref_cpu *cpu, int reg, uint32_t value);
+
+#endif  // REF_H
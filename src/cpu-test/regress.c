@@ -0,0 +1,75 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Runs single instructions through risc_single_step and checks the
+// results against values worked out by hand from the RISC5 description.
+// Each case is a bug that was once in the emulator.
+
+#include "../risc.c"
+
+#define F0(u, a, b, op, c) ((uint32_t)(u) << 29 | (uint32_t)(a) << 24 | (uint32_t)(b) << 20 | (uint32_t)(op) << 16 | (uint32_t)(c))
+
+static struct RISC *risc;
+static int failures;
+
+static void run(uint32_t ir) {
+  risc->RAM[0] = ir;
+  risc->PC = 0;
+  risc_single_step(risc);
+}
+
+static void expect(const char *name, const char *what, uint32_t got, uint32_t want) {
+  if (got != want) {
+    printf("regress: %s: %s is %08X, expected %08X\n", name, what, got, want);
+    failures++;
+  }
+}
+
+// A carry in that wraps the sum back to the first operand still
+// carries out.
+static void add_sub_carry(void) {
+  risc->R[2] = 5;
+  risc->R[3] = 0xFFFFFFFF;
+  risc->C = true;
+  run(F0(1, 1, 2, ADD, 3));  // ADD' R1, R2, R3
+  expect("ADD'", "R1", risc->R[1], 5);
+  expect("ADD'", "C", risc->C, 1);
+
+  risc->C = true;
+  run(F0(1, 1, 2, SUB, 3));  // SUB' R1, R2, R3
+  expect("SUB'", "R1", risc->R[1], 5);
+  expect("SUB'", "C", risc->C, 1);
+}
+
+// DIV without the u bit is signed for every divisor, not only for
+// positive ones. Dividing -7 by zero, the divider works on 7 and then
+// corrects quotient and remainder for the sign.
+static void div_signed(void) {
+  risc->R[2] = (uint32_t)-7;
+  risc->R[3] = 0;
+  run(F0(0, 1, 2, DIV, 3));  // DIV R1, R2, R3
+  expect("DIV", "R1", risc->R[1], 0);
+  expect("DIV", "H", risc->H, (uint32_t)-7);
+}
+
+// BL R15 jumps to the old value of R15, the link is written after the
+// target register is read.
+static void branch_link_r15(void) {
+  risc->R[15] = 0x100;
+  run(0xD700000F);  // BL R15
+  expect("BL R15", "PC", risc->PC * 4, 0x100);
+  expect("BL R15", "R15", risc->R[15], 4);
+}
+
+int main(void) {
+  risc = risc_new();
+  add_sub_carry();
+  div_signed();
+  branch_link_r15();
+  if (failures) {
+    return 1;
+  }
+  printf("regress: all cases pass\n");
+  return 0;
+}
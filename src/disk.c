@@ -1,3 +1,11 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#define _GNU_SOURCE
+#include <time.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdlib.h>
@@ -6,6 +14,16 @@
 #include <errno.h>
 #include "disk.h"
 
+// Number of sectors fetched at once when the guest reads sequentially.
+#define READAHEAD_SECTORS 32
+
+// RAM disks allocate memory in chunks of this many sectors, on first write.
+#define RAM_CHUNK_SECTORS 256
+
+// The guest picks the sector numbers, so RAM disks are limited to 1 GB.
+// Writes beyond that are dropped.
+#define RAM_MAX_SECTORS 0x200000
+
 enum DiskState {
   diskCommand,
   diskRead,
@@ -19,6 +37,23 @@ struct Disk {
   enum DiskState state;
   FILE *file;
   uint32_t offset;
+  uint32_t file_sectors;
+  uint32_t block_sectors;  // of the host filesystem, 0 if we can't punch holes
+
+  bool in_memory;
+  uint32_t **ram;
+  uint32_t ram_chunks;
+  uint32_t ram_sectors;
+  uint32_t write_secnum;
+
+  uint32_t last_read;
+  int seq_run;
+  uint32_t ra_start;
+  uint32_t ra_count;
+  uint32_t ra_buf[READAHEAD_SECTORS][128];
+
+  FILE *trace;
+  uint32_t trace_time;
 
   uint32_t rx_buf[128];
   int rx_idx;
@@ -32,12 +67,20 @@ struct Disk {
 static uint32_t disk_read(const struct RISC_SPI *spi);
 static void disk_write(const struct RISC_SPI *spi, uint32_t value);
 static void disk_run_command(struct Disk *disk);
+static void disk_read_sector(struct Disk *disk, uint32_t secnum, uint32_t buf[static 128]);
+static void disk_write_sector(struct Disk *disk, uint32_t secnum, uint32_t buf[static 128]);
 static void seek_sector(FILE *f, uint32_t secnum);
 static void read_sector(FILE *f, uint32_t buf[static 128]);
+static void read_sectors(FILE *f, uint32_t buf[][128], uint32_t count);
 static void write_sector(FILE *f, uint32_t buf[static 128]);
+static bool is_zero_sector(const uint32_t buf[static 128]);
+static bool punch_block(struct Disk *disk, uint32_t secnum);
+static uint32_t *ram_sector(struct Disk *disk, uint32_t secnum, bool allocate);
+static uint64_t host_nanos(void);
+static void trace_command(struct Disk *disk, uint32_t cmd, uint32_t sector, uint64_t start);
 
 
-struct RISC_SPI *disk_new(const char *filename) {
+static struct Disk *disk_alloc(void) {
   struct Disk *disk = calloc(1, sizeof(*disk));
   disk->spi = (struct RISC_SPI) {
     .read_data = disk_read,
@@ -45,6 +88,11 @@ struct RISC_SPI *disk_new(const char *filename) {
   };
 
   disk->state = diskCommand;
+  return disk;
+}
+
+struct RISC_SPI *disk_new(const char *filename) {
+  struct Disk *disk = disk_alloc();
 
   if (filename) {
     disk->file = fopen(filename, "rb+");
@@ -52,15 +100,102 @@ struct RISC_SPI *disk_new(const char *filename) {
       fprintf(stderr, "Can't open file \"%s\": %s\n", filename, strerror(errno));
       exit(1);
     }
+    fseek(disk->file, 0, SEEK_END);
+    disk->file_sectors = (uint32_t)((ftell(disk->file) + 511) / 512);
+    fseek(disk->file, 0, SEEK_SET);
 
     // Check for filesystem-only image, starting directly at sector 1 (DiskAdr 29)
     read_sector(disk->file, &disk->tx_buf[0]);
     disk->offset = (disk->tx_buf[0] == 0x9B1EA38D) ? 0x80002 : 0;
+
+#ifdef FALLOC_FL_PUNCH_HOLE
+    // Holes can only be punched in whole filesystem blocks, and we
+    // check a block's sectors in one read.
+    struct stat st;
+    if (fstat(fileno(disk->file), &st) == 0 && st.st_blksize >= 512 &&
+        st.st_blksize % 512 == 0 && st.st_blksize / 512 <= READAHEAD_SECTORS) {
+      disk->block_sectors = (uint32_t)(st.st_blksize / 512);
+    }
+#endif
   }
 
   return &disk->spi;
 }
 
+struct RISC_SPI *disk_new_ram(const char *filename) {
+  struct Disk *disk = disk_alloc();
+  disk->in_memory = true;
+
+  if (filename) {
+    FILE *f = fopen(filename, "rb");
+    if (f == 0) {
+      fprintf(stderr, "Can't open file \"%s\": %s\n", filename, strerror(errno));
+      exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    read_sector(f, &disk->tx_buf[0]);
+    disk->offset = (disk->tx_buf[0] == 0x9B1EA38D) ? 0x80002 : 0;
+
+    // All-zero sectors don't need any memory.
+    uint32_t buf[128];
+    if (size > (long)RAM_MAX_SECTORS * 512) {
+      fprintf(stderr, "Disk image \"%s\" is too large for a RAM disk\n", filename);
+      exit(1);
+    }
+    uint32_t sectors = (uint32_t)((size + 511) / 512);
+    seek_sector(f, 0);
+    for (uint32_t secnum = 0; secnum < sectors; secnum++) {
+      read_sector(f, buf);
+      if (!is_zero_sector(buf)) {
+        memcpy(ram_sector(disk, secnum, true), buf, 512);
+      }
+    }
+    disk->ram_sectors = sectors;
+    fclose(f);
+  }
+
+  return &disk->spi;
+}
+
+void disk_save(struct RISC_SPI *spi, const char *filename) {
+  struct Disk *disk = (struct Disk *)spi;
+  if (!disk->in_memory) {
+    return;
+  }
+  FILE *f = fopen(filename, "wb");
+  if (f == 0) {
+    fprintf(stderr, "Can't write file \"%s\": %s\n", filename, strerror(errno));
+    return;
+  }
+  uint32_t zero[128] = { 0 };
+  for (uint32_t secnum = 0; secnum < disk->ram_sectors; secnum++) {
+    uint32_t *buf = ram_sector(disk, secnum, false);
+    write_sector(f, buf ? buf : zero);
+  }
+  if (fclose(f) != 0) {
+    fprintf(stderr, "Can't write file \"%s\": %s\n", filename, strerror(errno));
+  }
+}
+
+void disk_trace(struct RISC_SPI *spi, const char *filename) {
+  struct Disk *disk = (struct Disk *)spi;
+  disk->trace = fopen(filename, "wb");
+  if (disk->trace == 0) {
+    fprintf(stderr, "Can't open file \"%s\": %s\n", filename, strerror(errno));
+    exit(1);
+  }
+  setvbuf(disk->trace, NULL, _IOFBF, 1 << 16);
+  fwrite(DISK_TRACE_MAGIC, 8, 1, disk->trace);
+}
+
+void disk_set_time(struct RISC_SPI *spi, uint32_t tick) {
+  struct Disk *disk = (struct Disk *)spi;
+  disk->trace_time = tick;
+}
+
 static void disk_write(const struct RISC_SPI *spi, uint32_t value) {
   struct Disk *disk = (struct Disk *)spi;
   disk->tx_idx++;
@@ -96,7 +231,9 @@ static void disk_write(const struct RISC_SPI *spi, uint32_t value) {
       }
       disk->rx_idx++;
       if (disk->rx_idx == 128) {
-        write_sector(disk->file, &disk->rx_buf[0]);
+        uint64_t start = disk->trace ? host_nanos() : 0;
+        disk_write_sector(disk, disk->write_secnum, &disk->rx_buf[0]);
+        trace_command(disk, 88, disk->write_secnum, start);
       }
       if (disk->rx_idx == 130) {
         disk->tx_buf[0] = 5;
@@ -130,17 +267,19 @@ static void disk_run_command(struct Disk *disk) {
 
   switch (cmd) {
     case 81: {
+      uint64_t start = disk->trace ? host_nanos() : 0;
       disk->state = diskRead;
       disk->tx_buf[0] = 0;
       disk->tx_buf[1] = 254;
-      seek_sector(disk->file, arg - disk->offset);
-      read_sector(disk->file, &disk->tx_buf[2]);
+      disk_read_sector(disk, arg - disk->offset, &disk->tx_buf[2]);
       disk->tx_cnt = 2 + 128;
+      trace_command(disk, 81, arg - disk->offset, start);
       break;
     }
     case 88: {
+      // The write itself is traced once the data block has arrived.
       disk->state = diskWrite;
-      seek_sector(disk->file, arg - disk->offset);
+      disk->write_secnum = arg - disk->offset;
       disk->tx_buf[0] = 0;
       disk->tx_cnt = 1;
       break;
@@ -154,6 +293,97 @@ static void disk_run_command(struct Disk *disk) {
   disk->tx_idx = -1;
 }
 
+// Sequential reads are served from a read-ahead buffer, refilled with
+// a single host read whenever the guest runs off its end. Oberon reads
+// 1K sectors as two 512 byte blocks, so a lone sector read isn't enough
+// to count as sequential access.
+static void disk_read_sector(struct Disk *disk, uint32_t secnum, uint32_t buf[static 128]) {
+  if (disk->in_memory) {
+    uint32_t *data = ram_sector(disk, secnum, false);
+    if (data) {
+      memcpy(buf, data, 512);
+    } else {
+      memset(buf, 0, 512);
+    }
+    return;
+  }
+
+  bool sequential = secnum == disk->last_read + 1;
+  disk->seq_run = sequential ? disk->seq_run + 1 : 0;
+  disk->last_read = secnum;
+
+  if (secnum - disk->ra_start >= disk->ra_count && disk->seq_run >= 2) {
+    seek_sector(disk->file, secnum);
+    read_sectors(disk->file, disk->ra_buf, READAHEAD_SECTORS);
+    disk->ra_start = secnum;
+    disk->ra_count = READAHEAD_SECTORS;
+  }
+  if (secnum - disk->ra_start < disk->ra_count) {
+    memcpy(buf, disk->ra_buf[secnum - disk->ra_start], 512);
+  } else {
+    seek_sector(disk->file, secnum);
+    read_sector(disk->file, buf);
+  }
+}
+
+// All-zero sectors are not stored if we can avoid it: they are skipped
+// past the end of the image, and punched out of it where supported once
+// the whole filesystem block around them is zero.
+static void disk_write_sector(struct Disk *disk, uint32_t secnum, uint32_t buf[static 128]) {
+  bool zero = is_zero_sector(buf);
+  if (disk->in_memory) {
+    if (secnum >= RAM_MAX_SECTORS) {
+      return;
+    }
+    if (!zero || ram_sector(disk, secnum, false)) {
+      memcpy(ram_sector(disk, secnum, true), buf, 512);
+    }
+    if (secnum >= disk->ram_sectors) {
+      disk->ram_sectors = secnum + 1;
+    }
+    return;
+  }
+  if (secnum - disk->ra_start < disk->ra_count) {
+    memcpy(disk->ra_buf[secnum - disk->ra_start], buf, 512);
+  }
+  if (zero && (secnum >= disk->file_sectors || punch_block(disk, secnum))) {
+    return;
+  }
+  seek_sector(disk->file, secnum);
+  write_sector(disk->file, buf);
+  if (secnum >= disk->file_sectors) {
+    disk->file_sectors = secnum + 1;
+  }
+}
+
+static uint32_t *ram_sector(struct Disk *disk, uint32_t secnum, bool allocate) {
+  uint32_t chunk = secnum / RAM_CHUNK_SECTORS;
+  if (chunk >= disk->ram_chunks) {
+    if (!allocate) {
+      return NULL;
+    }
+    uint32_t **ram = realloc(disk->ram, (chunk + 1) * sizeof(*ram));
+    if (ram == NULL) {
+      fprintf(stderr, "Out of memory for RAM disk\n");
+      exit(1);
+    }
+    memset(&ram[disk->ram_chunks], 0, (chunk + 1 - disk->ram_chunks) * sizeof(*ram));
+    disk->ram = ram;
+    disk->ram_chunks = chunk + 1;
+  }
+  if (disk->ram[chunk] == NULL) {
+    if (!allocate) {
+      return NULL;
+    }
+    disk->ram[chunk] = calloc(RAM_CHUNK_SECTORS, 512);
+    if (disk->ram[chunk] == NULL) {
+      fprintf(stderr, "Out of memory for RAM disk\n");
+      exit(1);
+    }
+  }
+  return &disk->ram[chunk][(secnum % RAM_CHUNK_SECTORS) * 128];
+}
+
 static void seek_sector(FILE *f, uint32_t secnum) {
   if (f) {
     fseek(f, secnum * 512, SEEK_SET);
@@ -173,6 +403,22 @@ static void read_sector(FILE *f, uint32_t buf[static 128]) {
   }
 }
 
+static void read_sectors(FILE *f, uint32_t buf[][128], uint32_t count) {
+  uint8_t bytes[READAHEAD_SECTORS * 512] = { 0 };
+  if (f) {
+    fread(bytes, 512, count, f);
+  }
+  for (uint32_t s = 0; s < count; s++) {
+    for (int i = 0; i < 128; i++) {
+      const uint8_t *p = &bytes[s*512 + i*4];
+      buf[s][i] = (uint32_t)p[0]
+        | ((uint32_t)p[1] << 8)
+        | ((uint32_t)p[2] << 16)
+        | ((uint32_t)p[3] << 24);
+    }
+  }
+}
+
 static void write_sector(FILE *f, uint32_t buf[static 128]) {
   if (f) {
     uint8_t bytes[512];
@@ -185,3 +431,83 @@ static void write_sector(FILE *f, uint32_t buf[static 128]) {
     fwrite(bytes, 512, 1, f);
   }
 }
+
+static bool is_zero_sector(const uint32_t buf[static 128]) {
+  uint32_t bits = 0;
+  for (int i = 0; i < 128; i++) {
+    bits |= buf[i];
+  }
+  return bits == 0;
+}
+
+// Punches out the filesystem block holding 'secnum' if its other
+// sectors are zero too. Returns false if the sector must be written.
+static bool punch_block(struct Disk *disk, uint32_t secnum) {
+#ifdef FALLOC_FL_PUNCH_HOLE
+  uint32_t count = disk->block_sectors;
+  if (count == 0) {
+    return false;
+  }
+  uint32_t first = secnum - secnum % count;
+  if (first + count > disk->file_sectors) {
+    return false;
+  }
+  uint32_t block[READAHEAD_SECTORS][128];
+  uint32_t (*sectors)[128] = block;
+  if (first - disk->ra_start < disk->ra_count && first + count - 1 - disk->ra_start < disk->ra_count) {
+    sectors = &disk->ra_buf[first - disk->ra_start];
+  } else {
+    seek_sector(disk->file, first);
+    read_sectors(disk->file, block, count);
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    if (first + i != secnum && !is_zero_sector(sectors[i])) {
+      return false;
+    }
+  }
+  fflush(disk->file);
+  return fallocate(fileno(disk->file), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                   (off_t)first * 512, (off_t)count * 512) == 0;
+#else
+  return false;
+#endif
+}
+
+static uint64_t host_nanos(void) {
+#ifdef _WIN32
+  LARGE_INTEGER count, freq;
+  QueryPerformanceCounter(&count);
+  QueryPerformanceFrequency(&freq);
+  return (uint64_t)(count.QuadPart / freq.QuadPart * 1000000000
+                    + count.QuadPart % freq.QuadPart * 1000000000 / freq.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// Trace records are 24 bytes, little endian:
+//   u32 command, u32 sector, u32 emulated time (ms),
+//   u32 host latency (ns), u64 host timestamp (ns)
+static void trace_command(struct Disk *disk, uint32_t cmd, uint32_t sector, uint64_t start) {
+  if (disk->trace) {
+    uint64_t end = host_nanos();
+    uint64_t latency = end - start;
+    uint32_t fields[4] = {
+      cmd, sector, disk->trace_time,
+      latency > UINT32_MAX ? UINT32_MAX : (uint32_t)latency
+    };
+    uint8_t bytes[24];
+    for (int i = 0; i < 4; i++) {
+      bytes[i*4+0] = (uint8_t)(fields[i]      );
+      bytes[i*4+1] = (uint8_t)(fields[i] >>  8);
+      bytes[i*4+2] = (uint8_t)(fields[i] >> 16);
+      bytes[i*4+3] = (uint8_t)(fields[i] >> 24);
+    }
+    for (int i = 0; i < 8; i++) {
+      bytes[16+i] = (uint8_t)(start >> (i * 8));
+    }
+    fwrite(bytes, 24, 1, disk->trace);
+  }
+}
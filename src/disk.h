@@ -3,6 +3,14 @@
 
 #include "risc-io.h"
 
+// Disk traces start with this 8-byte signature, see disk.c for the
+// record layout and tools/disktrace.rs for a summarizer.
+#define DISK_TRACE_MAGIC "ODSKTRC1"
+
 struct RISC_SPI *disk_new(const char *filename);
+struct RISC_SPI *disk_new_ram(const char *filename);
+void disk_save(struct RISC_SPI *spi, const char *filename);
+void disk_trace(struct RISC_SPI *spi, const char *filename);
+void disk_set_time(struct RISC_SPI *spi, uint32_t tick);
 
 #endif  // DISK_H
@@ -0,0 +1,113 @@
+#ifdef _WIN32
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "fb-export.h"
+
+struct FBExport *fb_export_new(const char *name, int width, int height) {
+  fprintf(stderr, "Shared memory export is not supported on Windows\n");
+  exit(1);
+}
+
+void fb_export_frame(struct FBExport *fb, struct RISC *risc, const struct Damage *damage) {
+}
+
+void fb_export_close(struct FBExport *fb) {
+}
+
+#else  // _WIN32
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "fb-export.h"
+
+// The front end calls fb_export_frame with the damage it got from
+// risc_get_framebuffer_damage, and only the damaged words are copied.
+
+struct FBExport {
+  char *name;
+  struct FBExportHeader *header;
+  uint32_t *pixels;
+  size_t size;
+  int words_per_line;
+};
+
+struct FBExport *fb_export_new(const char *name, int width, int height) {
+  struct FBExport *fb = calloc(1, sizeof(*fb));
+  // Portable names have exactly one slash, at the start.
+  fb->name = malloc(strlen(name) + 2);
+  sprintf(fb->name, "%s%s", name[0] == '/' ? "" : "/", name);
+  fb->words_per_line = width / 32;
+  fb->size = sizeof(struct FBExportHeader) + (size_t)fb->words_per_line * 4 * (size_t)height;
+
+  // Don't take over a segment that another emulator is still writing.
+  int fd = shm_open(fb->name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0 && errno == EEXIST) {
+    fprintf(stderr, "Shared memory \"%s\" already exists. If no other emulator is using it, "
+            "remove it (on Linux: rm /dev/shm%s).\n", fb->name, fb->name);
+    exit(1);
+  }
+  if (fd < 0 || ftruncate(fd, (off_t)fb->size) != 0) {
+    fprintf(stderr, "Can't create shared memory \"%s\": %s\n", fb->name, strerror(errno));
+    exit(1);
+  }
+  void *mem = mmap(NULL, fb->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED) {
+    fprintf(stderr, "Can't map shared memory \"%s\": %s\n", fb->name, strerror(errno));
+    exit(1);
+  }
+  fb->header = mem;
+  fb->pixels = (uint32_t *)(fb->header + 1);
+  fb->header->version = FB_EXPORT_VERSION;
+  fb->header->header_size = sizeof(struct FBExportHeader);
+  fb->header->width = (uint32_t)width;
+  fb->header->height = (uint32_t)height;
+  fb->header->stride = (uint32_t)fb->words_per_line * 4;
+  fb->header->damage_x1 = 0;
+  fb->header->damage_x2 = -1;
+  fb->header->damage_y1 = 0;
+  fb->header->damage_y2 = -1;
+  // The magic goes last, so a reader never sees a half set up header.
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(fb->header->magic, FB_EXPORT_MAGIC, sizeof(fb->header->magic));
+  return fb;
+}
+
+void fb_export_frame(struct FBExport *fb, struct RISC *risc, const struct Damage *damage) {
+  if (damage->y1 > damage->y2) {
+    return;
+  }
+  struct FBExportHeader *h = fb->header;
+  uint64_t sequence = h->sequence;
+  __atomic_store_n(&h->sequence, sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  const uint32_t *in = risc_get_framebuffer_ptr(risc);
+  size_t len = (size_t)(damage->x2 - damage->x1 + 1) * 4;
+  for (int line = damage->y1; line <= damage->y2; line++) {
+    int start = line * fb->words_per_line + damage->x1;
+    memcpy(&fb->pixels[start], &in[start], len);
+  }
+  h->damage_x1 = damage->x1;
+  h->damage_x2 = damage->x2;
+  h->damage_y1 = damage->y1;
+  h->damage_y2 = damage->y2;
+
+  __atomic_store_n(&h->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+void fb_export_close(struct FBExport *fb) {
+  munmap(fb->header, fb->size);
+  shm_unlink(fb->name);
+  free(fb->name);
+  free(fb);
+}
+
+#endif  // _WIN32
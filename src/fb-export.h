@@ -0,0 +1,50 @@
+#ifndef FB_EXPORT_H
+#define FB_EXPORT_H
+
+#include <stdint.h>
+#include "risc.h"
+
+// The framebuffer is published in a POSIX shared memory segment for
+// other processes to read. The segment starts with this header, and
+// the pixels follow at header_size: 1 bit per pixel, least significant
+// bit leftmost, bit set for white, lines bottom up, as Oberon has them.
+//
+// Readers copy what they need between two reads of sequence, which
+// is odd while a frame is being written, and retry if it changed:
+//
+//   do {
+//     s1 = atomic load-acquire of sequence;
+//     copy;
+//     acquire fence;
+//     s2 = load of sequence;
+//   } while (s1 != s2 || (s1 & 1));
+//
+// Each frame with damage adds 2 to sequence; frames that change nothing
+// leave the segment alone. The damage fields give what changed in the
+// last frame with damage, in 32-pixel columns and in lines counted from
+// the bottom (x1 > x2 or y1 > y2 if nothing); a reader that has missed
+// one should copy everything.
+
+#define FB_EXPORT_MAGIC "OBERONFB"
+#define FB_EXPORT_VERSION 1
+
+struct FBExportHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t width;           // pixels
+  uint32_t height;
+  uint32_t stride;          // bytes per line
+  uint32_t reserved;
+  uint64_t sequence;
+  int32_t damage_x1, damage_x2, damage_y1, damage_y2;
+  uint8_t padding[8];
+};
+
+struct FBExport;
+
+struct FBExport *fb_export_new(const char *name, int width, int height);
+void fb_export_frame(struct FBExport *fb, struct RISC *risc, const struct Damage *damage);
+void fb_export_close(struct FBExport *fb);
+
+#endif  // FB_EXPORT_H
@@ -3,6 +3,7 @@
 #include <stdio.h>
 
 #include "../risc-fp.h"
+#include "harness.h"
 #include "numbers.inc"
 #include "FPDivider.inc"
 
@@ -20,26 +21,16 @@ static uint32_t v_div(uint32_t in_x, uint32_t in_y) {
   return z();
 }
 
-
-
-int main() {
-  int count = 0;
-  int errors = 0;
-  for (int i = 0; i < numbers_cnt; i++) {
-    for (int j = 0; j < numbers_cnt; j++) {
-      uint32_t v = v_div(numbers[i], numbers[j]);
-      uint32_t fp = fp_div(numbers[i], numbers[j]);
-      if (v != fp && errors < 10) {
-        printf("div: %08x %08x => v %08x | fp %08x\n", numbers[i], numbers[j], v, fp);
-      }
-      errors += fp != v;
-      count += 1;
-    }
-    if ((i % 500) == 0) {
-      int p = count * 100 / numbers_cnt / numbers_cnt;
-      printf("div: %d%% (%d errors)\n", p, errors);
-    }
+static bool check(uint32_t in_x, uint32_t in_y, bool report) {
+  uint32_t v = v_div(in_x, in_y);
+  uint32_t fp = fp_div(in_x, in_y);
+  if (v != fp && report) {
+    printf("div: %08x %08x => v %08x | fp %08x\n", in_x, in_y, v, fp);
   }
-  printf("div: errors: %d tests: %d\n", errors, count);
-  return errors != 0;
+  return v != fp;
+}
+
+int main(int argc, char *argv[]) {
+  const struct fp_test test = { "div", 2, numbers, numbers_cnt, check };
+  return fp_test_main(argc, argv, &test);
 }
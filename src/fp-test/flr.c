@@ -3,6 +3,7 @@
 #include <stdio.h>
 
 #include "../risc-fp.h"
+#include "harness.h"
 #include "numbers.inc"
 #include "FPAdder.inc"
 
@@ -21,18 +22,16 @@ static uint32_t v_add(uint32_t in_x, uint32_t in_y) {
   return z();
 }
 
-int main() {
-  int count = 0;
-  int errors = 0;
-  for (int i = 0; i < numbers_cnt; i++) {
-    uint32_t v = v_add(numbers[i], 0x4B00U<<16);
-    uint32_t fp = fp_add(numbers[i], 0x4B00U<<16, 0, 1);
-    if (v != fp && errors < 10) {
-      printf("flr: %08x => v %08x | fp %08x\n", numbers[i], v, fp);
-    }
-    errors += fp != v;
-    count += 1;
+static bool check(uint32_t in_x, uint32_t in_y __attribute__((unused)), bool report) {
+  uint32_t v = v_add(in_x, 0x4B00U<<16);
+  uint32_t fp = fp_add(in_x, 0x4B00U<<16, 0, 1);
+  if (v != fp && report) {
+    printf("flr: %08x => v %08x | fp %08x\n", in_x, v, fp);
   }
-  printf("flr: errors: %d tests: %d\n", errors, count);
-  return errors != 0;
+  return v != fp;
+}
+
+int main(int argc, char *argv[]) {
+  const struct fp_test test = { "flr", 1, numbers, numbers_cnt, check };
+  return fp_test_main(argc, argv, &test);
 }
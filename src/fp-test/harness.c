@@ -0,0 +1,278 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/wait.h>
+
+#include "harness.h"
+
+// Runs a test over an operand sweep on all cores. The Verilog models
+// keep their state in globals, so the workers are processes. Each
+// input is a pure function of its index; the index space is cut into
+// chunks that are dealt out round robin, and finished chunks are
+// logged to the checkpoint file so an interrupted run can resume.
+
+#define CHUNK_SIZE (1 << 20)
+#define MAX_REPORTS 10
+
+enum sweep { NUMBERS, RANDOM, EXPONENTS, ALL };
+
+struct chunk_result {
+  uint64_t chunk;
+  uint64_t tests;
+  uint64_t errors;
+};
+
+static const struct fp_test *test;
+static enum sweep sweep = NUMBERS;
+static uint64_t sweep_arg;
+static uint64_t seed = 1;
+
+static uint64_t splitmix64(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+static uint64_t sweep_size(void) {
+  uint64_t n = (uint64_t)test->numbers_cnt;
+  switch (sweep) {
+    case NUMBERS:   return test->operands == 1 ? n : n * n;
+    case RANDOM:    return sweep_arg;
+    case EXPONENTS: return (test->operands == 1 ? 512 : 512 * 512) * sweep_arg;
+    case ALL:       return 1ULL << 32;
+  }
+  return 0;
+}
+
+// Operands with the given sign and exponent and a random mantissa.
+static uint32_t with_exponent(uint32_t se, uint64_t r) {
+  return (se << 23) | (uint32_t)(r & 0x7FFFFF);
+}
+
+static void sweep_input(uint64_t i, uint32_t *x, uint32_t *y) {
+  uint64_t n = (uint64_t)test->numbers_cnt;
+  *x = 0;
+  *y = 0;
+  switch (sweep) {
+    case NUMBERS: {
+      if (test->operands == 1) {
+        *x = test->numbers[i];
+      } else {
+        *x = test->numbers[i / n];
+        *y = test->numbers[i % n];
+      }
+      break;
+    }
+    case RANDOM: {
+      uint64_t r = splitmix64(seed ^ splitmix64(i));
+      *x = (uint32_t)r;
+      *y = (uint32_t)(r >> 32);
+      break;
+    }
+    case EXPONENTS: {
+      uint64_t r = splitmix64(seed ^ splitmix64(i));
+      uint64_t cell = i / sweep_arg;
+      *x = with_exponent((uint32_t)(cell % 512), r);
+      *y = with_exponent((uint32_t)(cell / 512), r >> 32);
+      break;
+    }
+    case ALL: {
+      *x = (uint32_t)i;
+      break;
+    }
+  }
+}
+
+static void sweep_name(char *buf, size_t len) {
+  static const char *names[] = { "numbers", "random", "exponents", "all" };
+  snprintf(buf, len, "%s %s %llu %llu %d", test->name, names[sweep],
+           (unsigned long long)sweep_arg, (unsigned long long)seed,
+           test->numbers_cnt);
+}
+
+static void run_worker(int fd, int worker, int workers, uint64_t chunks, const bool *done) {
+  uint64_t size = sweep_size();
+  uint64_t errors = 0;
+  for (uint64_t c = (uint64_t)worker; c < chunks; c += (uint64_t)workers) {
+    if (done[c]) {
+      continue;
+    }
+    struct chunk_result res = { c, 0, 0 };
+    uint64_t end = (c + 1) * CHUNK_SIZE < size ? (c + 1) * CHUNK_SIZE : size;
+    for (uint64_t i = c * CHUNK_SIZE; i < end; i++) {
+      uint32_t x, y;
+      sweep_input(i, &x, &y);
+      if (test->check(x, y, errors < MAX_REPORTS)) {
+        errors++;
+        res.errors++;
+      }
+      res.tests++;
+    }
+    if (write(fd, &res, sizeof(res)) != sizeof(res)) {
+      exit(2);
+    }
+  }
+  fflush(stdout);
+  exit(0);
+}
+
+// Returns the checkpoint file, positioned for appending, with the
+// chunks and totals of earlier runs filled in.
+static FILE *open_checkpoint(const char *filename, bool *done, uint64_t chunks,
+                             uint64_t *tests, uint64_t *errors) {
+  char name[256], line[256];
+  sweep_name(name, sizeof(name));
+  FILE *f = fopen(filename, "r");
+  if (f) {
+    if (!fgets(line, sizeof(line), f) || strncmp(line, name, strlen(name)) != 0 ||
+        line[strlen(name)] != '\n') {
+      fprintf(stderr, "%s: checkpoint %s is for a different sweep\n", test->name, filename);
+      exit(2);
+    }
+    unsigned long long c, t, e;
+    while (fscanf(f, "%llu %llu %llu", &c, &t, &e) == 3) {
+      if (c < chunks && !done[c]) {
+        done[c] = true;
+        *tests += t;
+        *errors += e;
+      }
+    }
+    fclose(f);
+    f = fopen(filename, "a");
+  } else {
+    f = fopen(filename, "w");
+    if (f) {
+      fprintf(f, "%s\n", name);
+    }
+  }
+  if (!f) {
+    perror(filename);
+    exit(2);
+  }
+  return f;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void usage(void) {
+  fprintf(stderr,
+          "Usage: %s [OPTIONS...]\n"
+          "\n"
+          "Sweeps (default: all pairs of the test numbers):\n"
+          "  --random N            N random inputs\n"
+          "  --exponents N         N random mantissas for every sign and exponent%s\n"
+          "  --all                 every 32-bit input (single operand tests only)\n"
+          "\n"
+          "Options:\n"
+          "  --seed N              Seed for the random sweeps\n"
+          "  --jobs N              Number of worker processes (default: all cores)\n"
+          "  --checkpoint FILE     Record progress in FILE and resume from it\n",
+          test->name, test->operands == 1 ? "" : " pair");
+  exit(2);
+}
+
+static const struct option long_options[] = {
+  { "random",     required_argument, NULL, 'r' },
+  { "exponents",  required_argument, NULL, 'e' },
+  { "all",        no_argument,       NULL, 'a' },
+  { "seed",       required_argument, NULL, 's' },
+  { "jobs",       required_argument, NULL, 'j' },
+  { "checkpoint", required_argument, NULL, 'c' },
+  { NULL,         no_argument,       NULL, 0   }
+};
+
+int fp_test_main(int argc, char *argv[], const struct fp_test *t) {
+  test = t;
+  long workers = sysconf(_SC_NPROCESSORS_ONLN);
+  const char *checkpoint = NULL;
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "r:e:as:j:c:", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'r': sweep = RANDOM; sweep_arg = strtoull(optarg, NULL, 0); break;
+      case 'e': sweep = EXPONENTS; sweep_arg = strtoull(optarg, NULL, 0); break;
+      case 'a': sweep = ALL; break;
+      case 's': seed = strtoull(optarg, NULL, 0); break;
+      case 'j': workers = strtol(optarg, NULL, 0); break;
+      case 'c': checkpoint = optarg; break;
+      default: usage();
+    }
+  }
+  if (optind != argc || workers < 1 || (sweep == ALL && test->operands != 1)) {
+    usage();
+  }
+
+  uint64_t size = sweep_size();
+  uint64_t chunks = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  bool *done = calloc(chunks + 1, sizeof(bool));
+  uint64_t tests = 0, errors = 0;
+  FILE *log = checkpoint ? open_checkpoint(checkpoint, done, chunks, &tests, &errors) : NULL;
+  uint64_t resumed = tests;
+
+  int fds[2];
+  if (pipe(fds) != 0) {
+    perror("pipe");
+    return 2;
+  }
+  fflush(stdout);
+  for (int w = 0; w < workers; w++) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(fds[0]);
+      run_worker(fds[1], w, (int)workers, chunks, done);
+    } else if (pid < 0) {
+      perror("fork");
+      return 2;
+    }
+  }
+  close(fds[1]);
+
+  double start = now(), last = start;
+  struct chunk_result res;
+  while (read(fds[0], &res, sizeof(res)) == sizeof(res)) {
+    tests += res.tests;
+    errors += res.errors;
+    if (log) {
+      fprintf(log, "%llu %llu %llu\n", (unsigned long long)res.chunk,
+              (unsigned long long)res.tests, (unsigned long long)res.errors);
+      fflush(log);
+    }
+    double t = now();
+    if (t - last >= 2) {
+      printf("%s: %d%% (%llu errors), %.1fM tests/s\n", test->name,
+             (int)(tests * 100 / size), (unsigned long long)errors,
+             (double)(tests - resumed) / (t - start) / 1e6);
+      fflush(stdout);
+      last = t;
+    }
+  }
+
+  bool failed = false;
+  int status;
+  while (wait(&status) > 0) {
+    failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+  }
+  if (log) {
+    fclose(log);
+  }
+  double secs = now() - start;
+  printf("%s: errors: %llu tests: %llu (%.1fs, %.1fM tests/s)\n", test->name,
+         (unsigned long long)errors, (unsigned long long)tests, secs,
+         secs > 0 ? (double)(tests - resumed) / secs / 1e6 : 0.0);
+  if (failed || tests != size) {
+    printf("%s: incomplete run\n", test->name);
+    return 2;
+  }
+  return errors != 0;
+}
@@ -0,0 +1,19 @@
+#ifndef HARNESS_H
+#define HARNESS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct fp_test {
+  const char *name;
+  int operands;  // 1 or 2
+  const uint32_t *numbers;
+  int numbers_cnt;
+  // Compares the Verilog model with the emulator for one input,
+  // returns true on a mismatch. Details are printed if report is set.
+  bool (*check)(uint32_t x, uint32_t y, bool report);
+};
+
+int fp_test_main(int argc, char *argv[], const struct fp_test *test);
+
+#endif  // HARNESS_H
@@ -3,6 +3,7 @@
 #include <stdio.h>
 
 #include "../risc-fp.h"
+#include "harness.h"
 #include "numbers.inc"
 #include "Divider.inc"
 
@@ -22,29 +23,48 @@ static struct idiv v_idiv(uint32_t in_x, uint32_t in_y, bool signed_div) {
 }
 
 
-int main() {
+// Divisors where the hardware's trial subtraction overflows, and the
+// boundaries around them.
+static const uint32_t special[] = {
+  0x00000000, 0x00000001, 0x00000002, 0x7FFFFFFE, 0x7FFFFFFF,
+  0x80000000, 0x80000001, 0xC0000000, 0xFFFFFFFE, 0xFFFFFFFF
+};
+static const int special_cnt = sizeof(special) / sizeof(special[0]);
+
+static bool check_mode(uint32_t x, uint32_t y, bool s, bool report) {
+  struct idiv v = v_idiv(x, y, s);
+  struct idiv e = idiv(x, y, s);
+  bool error = v.quot != e.quot || v.rem != e.rem;
+  if (error && report) {
+    printf("idiv (signed=%d): 0x%x %d => v (%d,%d) | emu (%d,%d)\n",
+           s, x, y, v.quot, v.rem, e.quot, e.rem);
+  }
+  return error;
+}
+
+static bool check(uint32_t x, uint32_t y, bool report) {
+  bool error = check_mode(x, y, 0, report);
+  return check_mode(x, y, 1, report && !error) || error;
+}
+
+int main(int argc, char *argv[]) {
   int count = 0;
   int errors = 0;
-  for (int s = 0; s < 2; s++) {
-    for (int i = 0; i < numbers_cnt; i++) {
-      for (int j = 0; j < numbers_cnt; j++) {
-        struct idiv v = v_idiv(numbers[i], numbers[j], s);
-        struct idiv e = idiv(numbers[i], numbers[j], s);
-        bool error = v.quot != e.quot || v.rem != e.rem;
-        if (error && errors < 20) {
-          printf("idiv (signed=%d): 0x%x %d => v (%d,%d) | emu (%d,%d)\n",
-                 s, numbers[i], numbers[j],
-                 v.quot, v.rem, e.quot, e.rem);
-        }
-        errors += error;
-        count += 1;
-      }
-      if ((i % 500) == 0) {
-        int p = count * 100LL / numbers_cnt / numbers_cnt / 2;
-        printf("idiv: %d%% (%d errors)\n", p, errors);
-      }
+  for (int i = 0; i < special_cnt; i++) {
+    for (int j = 0; j < numbers_cnt; j++) {
+      errors += check(numbers[j], special[i], errors < 20);
+      errors += check(special[i], numbers[j], errors < 20);
+      errors += check(numbers[j], -numbers[j], errors < 20);
+      count += 3;
+    }
+    for (int j = 0; j < special_cnt; j++) {
+      errors += check(special[i], special[j], errors < 20);
+      count += 1;
     }
   }
-  printf("idiv: errors: %d tests: %d\n", errors, count);
-  return errors != 0;
+  printf("idiv: special divisors: errors: %d tests: %d\n", errors, count);
+
+  const struct fp_test test = { "idiv", 2, numbers, numbers_cnt, check };
+  int result = fp_test_main(argc, argv, &test);
+  return result ? result : errors != 0;
 }
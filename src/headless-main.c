@@ -0,0 +1,230 @@
+#define _POSIX_C_SOURCE 200809L
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "risc.h"
+#include "risc-io.h"
+#include "disk.h"
+#include "host-fifo.h"
+#include "input-log.h"
+#include "fb-export.h"
+#include "screen-log.h"
+
+// Runs the emulator without a display, in virtual time, until a
+// recorded session has been played back or a number of frames has
+// been run. Prints a summary that can be compared between runs.
+
+#define CPU_HZ 25000000
+#define FPS 60
+
+static struct option long_options[] = {
+  { "mem",              required_argument, NULL, 'm' },
+  { "size",             required_argument, NULL, 's' },
+  { "virtual-time",     required_argument, NULL, 'V' },
+  { "replay",           required_argument, NULL, 'P' },
+  { "frames",           required_argument, NULL, 'n' },
+  { "ram-disk",         optional_argument, NULL, 'r' },
+  { "ram-disk-save",    required_argument, NULL, 'w' },
+  { "host-fifo",        required_argument, NULL, 'H' },
+  { "shm",              required_argument, NULL, 'M' },
+  { "record-screen",    required_argument, NULL, 'G' },
+  { NULL,               no_argument,       NULL, 0   }
+};
+
+static void usage() {
+  puts("Usage: risc-headless [OPTIONS...] DISK-IMAGE\n"
+       "\n"
+       "Options:\n"
+       "  --mem MEGS            Set memory size\n"
+       "  --size WIDTHxHEIGHT   Set framebuffer size\n"
+       "  --virtual-time MHZ    Set the emulated clock rate (default 25)\n"
+       "  --replay FILE         Play back input recorded with 'risc --record'\n"
+       "  --frames N            Stop after N frames\n"
+       "  --ram-disk[=IMAGE]    Attach a RAM disk as second drive, optionally\n"
+       "                        seeded from IMAGE\n"
+       "  --ram-disk-save FILE  Save the RAM disk to FILE on exit\n"
+       "  --host-fifo FILE      Write the guest's host FIFO output to FILE\n"
+       "                        (- for stdout)\n"
+       "  --shm NAME            Export the framebuffer in shared memory NAME\n"
+       "  --record-screen FILE  Record the screen to FILE (see tools/screenrec)\n"
+       );
+  exit(1);
+}
+
+static uint64_t framebuffer_hash(struct RISC *risc, int width, int height) {
+  const uint32_t *fb = risc_get_framebuffer_ptr(risc);
+  uint64_t hash = 14695981039346656037ULL;  // FNV-1a
+  for (int i = 0; i < width / 32 * height; i++) {
+    for (int b = 0; b < 32; b += 8) {
+      hash = (hash ^ ((fb[i] >> b) & 0xFF)) * 1099511628211ULL;
+    }
+  }
+  return hash;
+}
+
+static double host_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1000 + (double)ts.tv_nsec / 1000000;
+}
+
+int main (int argc, char *argv[]) {
+  struct RISC *risc = risc_new();
+
+  int width = RISC_FRAMEBUFFER_WIDTH;
+  int height = RISC_FRAMEBUFFER_HEIGHT;
+  bool size_option = false;
+  int mem_option = 0;
+  uint32_t cycles_per_ms = CPU_HZ / 1000;
+  int cycles_per_frame = CPU_HZ / FPS;
+  struct InputPlayer *player = NULL;
+  long max_frames = -1;
+  struct RISC_HostFIFO *host_fifo = NULL;
+  const char *shm_name = NULL;
+  const char *screen_file = NULL;
+  bool ram_disk = false;
+  const char *ram_disk_image = NULL;
+  const char *ram_disk_save = NULL;
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "m:s:V:P:n:r::w:H:M:G:", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'm': {
+        if (sscanf(optarg, "%d", &mem_option) != 1) {
+          usage();
+        }
+        break;
+      }
+      case 's': {
+        if (sscanf(optarg, "%dx%d", &width, &height) != 2 ||
+            width < 32 || width > 2048 || height < 32 || height > 2048) {
+          usage();
+        }
+        width &= ~31;
+        size_option = true;
+        break;
+      }
+      case 'V': {
+        double mhz = strtod(optarg, 0);
+        if (!(mhz >= 1 && mhz <= 1000)) {
+          usage();
+        }
+        cycles_per_ms = (uint32_t)(mhz * 1000);
+        cycles_per_frame = (int)(mhz * 1000000 / FPS);
+        break;
+      }
+      case 'P': {
+        player = input_player_new(optarg);
+        break;
+      }
+      case 'n': {
+        if (sscanf(optarg, "%ld", &max_frames) != 1 || max_frames < 0) {
+          usage();
+        }
+        break;
+      }
+      case 'r': {
+        ram_disk = true;
+        ram_disk_image = optarg;
+        break;
+      }
+      case 'w': {
+        ram_disk = true;
+        ram_disk_save = optarg;
+        break;
+      }
+      case 'H': {
+        host_fifo = host_fifo_new(optarg);
+        risc_set_host_fifo(risc, host_fifo);
+        break;
+      }
+      case 'M': {
+        shm_name = optarg;
+        break;
+      }
+      case 'G': {
+        screen_file = optarg;
+        break;
+      }
+      default: {
+        usage();
+      }
+    }
+  }
+  if (optind != argc - 1 || (!player && max_frames < 0)) {
+    usage();
+  }
+
+  if (mem_option || size_option) {
+    risc_configure_memory(risc, mem_option, width, height);
+  }
+  if (player) {
+    if (input_player_cycles_per_ms(player) == 0) {
+      fprintf(stderr, "Warning: input was not recorded in virtual time, "
+                      "playback will not be exact\n");
+    } else {
+      cycles_per_ms = input_player_cycles_per_ms(player);
+    }
+    cycles_per_frame = (int)input_player_cycles_per_frame(player);
+  }
+  risc_set_virtual_time(risc, cycles_per_ms);
+  risc_set_spi(risc, 1, disk_new(argv[optind]));
+  struct RISC_SPI *ram_disk_spi = NULL;
+  if (ram_disk) {
+    ram_disk_spi = disk_new_ram(ram_disk_image);
+    risc_set_spi(risc, 2, ram_disk_spi);
+  }
+  struct FBExport *fb_export = NULL;
+  if (shm_name) {
+    fb_export = fb_export_new(shm_name, width, height);
+  }
+  struct ScreenRecorder *screen_recorder = NULL;
+  if (screen_file) {
+    screen_recorder = screen_recorder_new(screen_file, width, height);
+  }
+
+  double start = host_ms();
+  long frames = 0;
+  while (frames != max_frames) {
+    if (player && !input_player_feed(player, risc)) {
+      break;
+    }
+    risc_run(risc, cycles_per_frame);
+    if (host_fifo) {
+      host_fifo_flush(host_fifo);
+    }
+    if (fb_export || screen_recorder) {
+      struct Damage damage = risc_get_framebuffer_damage(risc);
+      if (fb_export) {
+        fb_export_frame(fb_export, risc, &damage);
+      }
+      if (screen_recorder) {
+        screen_recorder_frame(screen_recorder, risc, &damage);
+      }
+    }
+    frames++;
+  }
+  double host_time = host_ms() - start;
+
+  fprintf(stderr, "frames:      %ld\n", frames);
+  fprintf(stderr, "guest time:  %u ms\n", risc_get_time(risc));
+  fprintf(stderr, "host time:   %.0f ms\n", host_time);
+  fprintf(stderr, "cycles:      %llu\n", (unsigned long long)risc_get_cycles(risc));
+  fprintf(stderr, "framebuffer: %016llx\n", (unsigned long long)framebuffer_hash(risc, width, height));
+  if (ram_disk_save) {
+    disk_save(ram_disk_spi, ram_disk_save);
+  }
+  if (player) {
+    input_player_free(player);
+  }
+  if (fb_export) {
+    fb_export_close(fb_export);
+  }
+  if (screen_recorder) {
+    screen_recorder_close(screen_recorder);
+  }
+  return 0;
+}
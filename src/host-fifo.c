@@ -0,0 +1,59 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "host-fifo.h"
+
+// A one-way stream from the guest to a host file, for logs and other
+// bulk output. Data is buffered here and written out in large chunks;
+// the front end flushes the buffer once per frame.
+
+#define BUFFER_SIZE (1 << 20)
+
+struct HostFIFO {
+  struct RISC_HostFIFO fifo;
+  FILE *file;
+};
+
+static uint32_t fifo_read_status(const struct RISC_HostFIFO *fifo) {
+  return 1;
+}
+
+static void fifo_write_data(const struct RISC_HostFIFO *fifo, uint32_t value) {
+  struct HostFIFO *f = (struct HostFIFO *)fifo;
+  putc((int)(value & 0xFF), f->file);
+}
+
+static void fifo_write_block(const struct RISC_HostFIFO *fifo, const uint8_t *data, uint32_t len) {
+  struct HostFIFO *f = (struct HostFIFO *)fifo;
+  if (len == 0) {
+    fflush(f->file);
+  } else {
+    fwrite(data, 1, len, f->file);
+  }
+}
+
+struct RISC_HostFIFO *host_fifo_new(const char *filename) {
+  struct HostFIFO *f = calloc(1, sizeof(*f));
+  f->fifo = (struct RISC_HostFIFO){
+    .read_status = fifo_read_status,
+    .write_data = fifo_write_data,
+    .write_block = fifo_write_block
+  };
+  if (strcmp(filename, "-") == 0) {
+    f->file = stdout;
+  } else {
+    f->file = fopen(filename, "wb");
+    if (!f->file) {
+      fprintf(stderr, "Can't open file \"%s\": %s\n", filename, strerror(errno));
+      exit(1);
+    }
+  }
+  setvbuf(f->file, NULL, _IOFBF, BUFFER_SIZE);
+  return &f->fifo;
+}
+
+void host_fifo_flush(const struct RISC_HostFIFO *fifo) {
+  struct HostFIFO *f = (struct HostFIFO *)fifo;
+  fflush(f->file);
+}
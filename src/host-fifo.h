@@ -0,0 +1,9 @@
+#ifndef HOST_FIFO_H
+#define HOST_FIFO_H
+
+#include "risc-io.h"
+
+struct RISC_HostFIFO *host_fifo_new(const char *filename);
+void host_fifo_flush(const struct RISC_HostFIFO *fifo);
+
+#endif  // HOST_FIFO_H
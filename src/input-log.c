@@ -0,0 +1,224 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "input-log.h"
+
+// Records the mouse and keyboard input given to the emulator so that a
+// session can be played back later, e.g. for benchmarks.
+//
+// File format: the magic string, the clock settings of the recording
+// and a list of events. All numbers are LEB128 encoded; event times
+// are the difference in cycles from the previous event.
+//
+//   'M' time x y             mouse moved
+//   'B' time button down     mouse button
+//   'K' time len byte...     scancodes
+//   'E' time                 end of recording
+//
+// Front ends feed input between calls to risc_run, so the events land
+// on the same instructions again if the playback runs the same number
+// of cycles per frame in virtual time.
+
+#define MAGIC "OINPUT01"
+#define MAX_KEYS 4096
+
+struct InputRecorder {
+  struct RISC_InputLog log;
+  FILE *file;
+  uint64_t last_cycles;
+};
+
+struct InputPlayer {
+  FILE *file;
+  const char *filename;
+  uint32_t cycles_per_ms;
+  uint32_t cycles_per_frame;
+  uint64_t cycles;   // time of the pending event
+  int type;          // pending event, 0 if none
+  uint32_t x, y;
+  uint8_t keys[MAX_KEYS];
+  uint32_t len;
+};
+
+static void put_number(FILE *f, uint64_t n) {
+  while (n >= 0x80) {
+    putc((int)(n & 0x7F) | 0x80, f);
+    n >>= 7;
+  }
+  putc((int)n, f);
+}
+
+static void put_event(struct InputRecorder *rec, int type, uint64_t cycles) {
+  putc(type, rec->file);
+  put_number(rec->file, cycles - rec->last_cycles);
+  rec->last_cycles = cycles;
+}
+
+static void record_mouse_moved(const struct RISC_InputLog *log, uint64_t cycles, int x, int y) {
+  struct InputRecorder *rec = (struct InputRecorder *)log;
+  put_event(rec, 'M', cycles);
+  put_number(rec->file, (uint64_t)x);
+  put_number(rec->file, (uint64_t)y);
+}
+
+static void record_mouse_button(const struct RISC_InputLog *log, uint64_t cycles, int button, bool down) {
+  struct InputRecorder *rec = (struct InputRecorder *)log;
+  put_event(rec, 'B', cycles);
+  put_number(rec->file, (uint64_t)button);
+  put_number(rec->file, down);
+}
+
+static void record_keyboard_input(const struct RISC_InputLog *log, uint64_t cycles,
+                                  const uint8_t *scancodes, uint32_t len) {
+  struct InputRecorder *rec = (struct InputRecorder *)log;
+  put_event(rec, 'K', cycles);
+  put_number(rec->file, len);
+  fwrite(scancodes, 1, len, rec->file);
+}
+
+struct RISC_InputLog *input_recorder_new(const char *filename, uint32_t cycles_per_ms, uint32_t cycles_per_frame) {
+  struct InputRecorder *rec = calloc(1, sizeof(*rec));
+  rec->log = (struct RISC_InputLog){
+    .mouse_moved = record_mouse_moved,
+    .mouse_button = record_mouse_button,
+    .keyboard_input = record_keyboard_input
+  };
+  rec->file = fopen(filename, "wb");
+  if (!rec->file) {
+    fprintf(stderr, "Can't open file \"%s\": %s\n", filename, strerror(errno));
+    exit(1);
+  }
+  fputs(MAGIC, rec->file);
+  put_number(rec->file, cycles_per_ms);
+  put_number(rec->file, cycles_per_frame);
+  return &rec->log;
+}
+
+void input_recorder_close(const struct RISC_InputLog *log, uint64_t cycles) {
+  struct InputRecorder *rec = (struct InputRecorder *)log;
+  put_event(rec, 'E', cycles);
+  if (fclose(rec->file) != 0) {
+    fprintf(stderr, "Can't write input recording: %s\n", strerror(errno));
+  }
+  free(rec);
+}
+
+
+static void bad_recording(struct InputPlayer *player) {
+  fprintf(stderr, "Input recording \"%s\" is corrupt\n", player->filename);
+  exit(1);
+}
+
+static uint64_t get_number(struct InputPlayer *player) {
+  uint64_t n = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = getc(player->file);
+    if (c == EOF) {
+      bad_recording(player);
+    }
+    n |= (uint64_t)(c & 0x7F) << shift;
+    if (c < 0x80) {
+      return n;
+    }
+  }
+  bad_recording(player);
+  return 0;
+}
+
+static void read_event(struct InputPlayer *player) {
+  int type = getc(player->file);
+  if (type == EOF) {
+    // Recordings cut short by a crash have no end marker.
+    player->type = 0;
+    return;
+  }
+  player->type = type;
+  player->cycles += get_number(player);
+  switch (type) {
+    case 'M':
+    case 'B': {
+      player->x = (uint32_t)get_number(player);
+      player->y = (uint32_t)get_number(player);
+      break;
+    }
+    case 'K': {
+      player->len = (uint32_t)get_number(player);
+      if (player->len > MAX_KEYS ||
+          fread(player->keys, 1, player->len, player->file) != player->len) {
+        bad_recording(player);
+      }
+      break;
+    }
+    case 'E': {
+      break;
+    }
+    default: {
+      bad_recording(player);
+    }
+  }
+}
+
+struct InputPlayer *input_player_new(const char *filename) {
+  struct InputPlayer *player = calloc(1, sizeof(*player));
+  player->filename = filename;
+  player->file = fopen(filename, "rb");
+  if (!player->file) {
+    fprintf(stderr, "Can't open file \"%s\": %s\n", filename, strerror(errno));
+    exit(1);
+  }
+  char magic[sizeof(MAGIC) - 1];
+  if (fread(magic, 1, sizeof(magic), player->file) != sizeof(magic) ||
+      memcmp(magic, MAGIC, sizeof(magic)) != 0) {
+    fprintf(stderr, "\"%s\" is not an input recording\n", filename);
+    exit(1);
+  }
+  player->cycles_per_ms = (uint32_t)get_number(player);
+  player->cycles_per_frame = (uint32_t)get_number(player);
+  read_event(player);
+  return player;
+}
+
+uint32_t input_player_cycles_per_ms(struct InputPlayer *player) {
+  return player->cycles_per_ms;
+}
+
+uint32_t input_player_cycles_per_frame(struct InputPlayer *player) {
+  return player->cycles_per_frame;
+}
+
+// Passes on all events that are due. Returns false once the end of
+// the recording has been reached.
+bool input_player_feed(struct InputPlayer *player, struct RISC *risc) {
+  while (player->type && player->cycles <= risc_get_cycles(risc)) {
+    switch (player->type) {
+      case 'M': {
+        risc_mouse_moved(risc, (int)player->x, (int)player->y);
+        break;
+      }
+      case 'B': {
+        risc_mouse_button(risc, (int)player->x, player->y != 0);
+        break;
+      }
+      case 'K': {
+        if (!risc_keyboard_input(risc, player->keys, player->len)) {
+          // Only happens if the playback went out of step; try again
+          // once the guest caught up.
+          return true;
+        }
+        break;
+      }
+      case 'E': {
+        player->type = 0;
+        return false;
+      }
+    }
+    read_event(player);
+  }
+  return player->type != 0;
+}
+
+void input_player_free(struct InputPlayer *player) {
+  fclose(player->file);
+  free(player);
+}
@@ -0,0 +1,19 @@
+#ifndef INPUT_LOG_H
+#define INPUT_LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "risc.h"
+
+struct InputPlayer;
+
+struct RISC_InputLog *input_recorder_new(const char *filename, uint32_t cycles_per_ms, uint32_t cycles_per_frame);
+void input_recorder_close(const struct RISC_InputLog *log, uint64_t cycles);
+
+struct InputPlayer *input_player_new(const char *filename);
+uint32_t input_player_cycles_per_ms(struct InputPlayer *player);
+uint32_t input_player_cycles_per_frame(struct InputPlayer *player);
+bool input_player_feed(struct InputPlayer *player, struct RISC *risc);
+void input_player_free(struct InputPlayer *player);
+
+#endif  // INPUT_LOG_H
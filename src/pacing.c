@@ -0,0 +1,135 @@
+#include <stdlib.h>
+#include "pacing.h"
+
+// Paces the main loop of a front end: how many cycles to run in the
+// next slice, when a frame is due and how long to wait. All times are
+// host milliseconds, measured by the caller.
+//
+// Slices are scheduled back to back in real time. When the host falls
+// behind that schedule, frames are shown less often first, down to
+// one every MAX_FRAME_MS; only if that does not help either does the
+// guest lose time. While input is arriving the slices get shorter, so
+// that the guest sees the input sooner.
+
+#define MIN_SLICE_MS       2.0
+#define INTERACTIVE_SLICES 4       // slices per frame while there is input
+#define INTERACTIVE_MS     500.0   // ... after the last event
+#define MAX_FRAME_MS       100.0
+#define MAX_LAG_MS         100.0   // then the guest runs slower
+#define IDLE_MS            1000.0  // idle this long before long waits
+#define IDLE_SLICE_MS      100.0   // of up to this length
+
+struct Pacing {
+  double cycles_per_ms;
+  int fixed_cycles;      // nonzero if the slices can't change
+  double frame_ms;       // target time between frames
+  double present_ms;     // current time between frames
+  double slice_ms;       // length of the current slice
+  double deadline;       // start of the next slice
+  double next_present;
+  double last_input;
+  double idle_since;     // negative while the guest is busy
+  bool started;
+};
+
+// With fixed_cycles, every slice has that many cycles (for recording
+// and replaying input, which is fed between slices).
+struct Pacing *pacing_new(uint32_t cycles_per_ms, int fps, int fixed_cycles) {
+  struct Pacing *pacing = calloc(1, sizeof(*pacing));
+  pacing->cycles_per_ms = cycles_per_ms;
+  pacing->fixed_cycles = fixed_cycles;
+  pacing->frame_ms = 1000.0 / fps;
+  pacing->present_ms = pacing->frame_ms;
+  pacing->slice_ms = fixed_cycles ? fixed_cycles / pacing->cycles_per_ms : pacing->frame_ms;
+  pacing->last_input = -INTERACTIVE_MS;
+  pacing->idle_since = -1;
+  return pacing;
+}
+
+int pacing_next_slice(struct Pacing *pacing, double now) {
+  if (!pacing->started) {
+    pacing->deadline = now;
+    pacing->next_present = now;
+    pacing->started = true;
+  }
+  if (pacing->fixed_cycles) {
+    return pacing->fixed_cycles;
+  }
+  pacing->slice_ms = pacing->frame_ms;
+  // Not while frames are being dropped, the host is busy enough.
+  if (now - pacing->last_input < INTERACTIVE_MS && pacing->present_ms == pacing->frame_ms) {
+    double ms = pacing->frame_ms / INTERACTIVE_SLICES;
+    if (ms < MIN_SLICE_MS) {
+      ms = MIN_SLICE_MS;
+    }
+    if (ms < pacing->slice_ms) {
+      pacing->slice_ms = ms;
+    }
+  }
+  return (int)(pacing->slice_ms * pacing->cycles_per_ms + 0.5);
+}
+
+void pacing_input(struct Pacing *pacing, double now) {
+  pacing->last_input = now;
+  // The input ended the wait for an idle guest early.
+  if (pacing->idle_since >= 0 && pacing->deadline > now) {
+    pacing->deadline = now;
+  }
+}
+
+void pacing_ran(struct Pacing *pacing, double now, int cycles, int executed) {
+  if (executed < cycles) {
+    if (pacing->idle_since < 0) {
+      pacing->idle_since = now;
+    }
+  } else {
+    pacing->idle_since = -1;
+  }
+}
+
+bool pacing_present_due(struct Pacing *pacing, double now) {
+  // Waits are only accurate to a millisecond or so.
+  return now >= pacing->next_present - pacing->slice_ms / 2;
+}
+
+// Called when a frame was due, changed tells if anything was drawn.
+void pacing_presented(struct Pacing *pacing, double now, bool changed) {
+  if (changed) {
+    pacing->idle_since = -1;
+  }
+  pacing->next_present += pacing->present_ms;
+  if (pacing->next_present < now) {
+    pacing->next_present = now;
+  }
+}
+
+// Returns how long to wait before the next slice. Long waits for an
+// idle guest are only allowed with allow_long.
+double pacing_wait(struct Pacing *pacing, double now, bool allow_long) {
+  pacing->deadline += pacing->slice_ms;
+  double lag = now - pacing->deadline;
+  if (lag > pacing->slice_ms) {
+    pacing->present_ms *= 1.25;
+    if (pacing->present_ms > MAX_FRAME_MS) {
+      pacing->present_ms = MAX_FRAME_MS;
+    }
+  } else if (lag < 0) {
+    pacing->present_ms *= 0.9;
+    if (pacing->present_ms < pacing->frame_ms) {
+      pacing->present_ms = pacing->frame_ms;
+    }
+  }
+  if (lag > MAX_LAG_MS) {
+    pacing->deadline = now;
+  }
+  if (allow_long && pacing->idle_since >= 0 && now - pacing->idle_since >= IDLE_MS &&
+      pacing->slice_ms < IDLE_SLICE_MS) {
+    pacing->deadline += IDLE_SLICE_MS - pacing->slice_ms;
+  }
+  double wait = pacing->deadline - now;
+  return wait > 0 ? wait : 0;
+}
+
+bool pacing_guest_idle(struct Pacing *pacing) {
+  return pacing->idle_since >= 0;
+}
@@ -0,0 +1,18 @@
+#ifndef PACING_H
+#define PACING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct Pacing;
+
+struct Pacing *pacing_new(uint32_t cycles_per_ms, int fps, int fixed_cycles);
+int pacing_next_slice(struct Pacing *pacing, double now);
+void pacing_input(struct Pacing *pacing, double now);
+void pacing_ran(struct Pacing *pacing, double now, int cycles, int executed);
+bool pacing_present_due(struct Pacing *pacing, double now);
+void pacing_presented(struct Pacing *pacing, double now, bool changed);
+double pacing_wait(struct Pacing *pacing, double now, bool allow_long);
+bool pacing_guest_idle(struct Pacing *pacing);
+
+#endif  // PACING_H
@@ -1,8 +1,23 @@
 // pclink.c for Peter De Wachter's RISC emulator PDR 20.3.14
+#ifdef _WIN32
+#include <windows.h>
+#else
+#define _POSIX_C_SOURCE 200112L
+#include <time.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <glob.h>
+#endif
+#include <dirent.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include "pclink.h"
@@ -11,6 +26,17 @@
 #define REC 0x21
 #define SND 0x22
 
+// The PCLink1 task polls the status register continuously, so we only
+// look for new jobs this often (in milliseconds).
+#define JOB_CHECK_INTERVAL 50
+
+// Files sent to Oberon that are larger than this are mapped rather
+// than read into memory.
+#define MMAP_THRESHOLD (256 * 1024)
+
+// Upper limit for the size of a job file.
+#define MAX_JOB_SIZE (64 * 1024)
+
 #ifndef S_IRGRP
 #define S_IRGRP 0
 #endif
@@ -30,58 +56,349 @@
 
 static const char * RecName = "PCLink.REC";  // e.g. echo Test.Mod > PCLink.REC
 static const char * SndName = "PCLink.SND";
+static const char * RecDoneName = "PCLink.REC.done";
+static const char * SndDoneName = "PCLink.SND.done";
 static uint8_t mode = 0;
 static int fd = -1;
 static int txcount, rxcount, fnlen, flen;
 static char szFilename[32];
 static char buf[257];
 
-static bool GetJob(const char *JobName) {
-  bool res = false;
+// The file being transferred is staged here in its entirety.
+static uint8_t *data;
+static size_t data_len, data_cap, data_pos;
+static bool data_mapped;
+
+// A job file lists any number of files, which are transferred back to
+// back. For REC jobs, the entries can also be directories or (outside
+// Windows) glob patterns; they are sent under their base name.
+struct JobEntry {
+  char *path;
+  char name[32];
+  long result;  // bytes transferred, or -1 on failure
+};
+
+static uint8_t job_mode = 0;
+static struct JobEntry *jobs;
+static int job_count, job_cap, job_next;
+
+static bool job_check_init = false;
+static bool job_pending = true;
+static uint32_t job_check_time;
+#ifdef __linux__
+static int job_watch = -1;
+#endif
+
+static void AddJob(const char *path) {
+  const char *name = strrchr(path, '/');
+  name = name ? name + 1 : path;
+  if (job_count == job_cap) {
+    job_cap = job_cap ? job_cap * 2 : 16;
+    jobs = realloc(jobs, (size_t)job_cap * sizeof(*jobs));
+    if (!jobs) {
+      fprintf(stderr, "PCLink: out of memory\n");
+      exit(1);
+    }
+  }
+  struct JobEntry *job = &jobs[job_count++];
+  job->path = malloc(strlen(path) + 1);
+  if (!job->path) {
+    fprintf(stderr, "PCLink: out of memory\n");
+    exit(1);
+  }
+  strcpy(job->path, path);
+  job->name[0] = 0;
+  if (strlen(name) < sizeof(job->name)) {
+    strcpy(job->name, name);
+  }
+  job->result = -1;
+}
+
+static void AddDirectory(const char *path) {
+  DIR *dir = opendir(path);
+  struct dirent *ent;
+  char full[1024 + 256];
+  struct stat st;
+
+  if (!dir) {
+    return;
+  }
+  while ((ent = readdir(dir)) != NULL) {
+    if (ent->d_name[0] == '.') {
+      continue;
+    }
+    snprintf(full, sizeof(full), "%s/%s", path, ent->d_name);
+    if (stat(full, &st) == 0 && S_ISREG(st.st_mode)) {
+      AddJob(full);
+    }
+  }
+  closedir(dir);
+}
+
+static void AddRecJobs(const char *pattern) {
+  struct stat st;
+
+  if (stat(pattern, &st) == 0 && S_ISDIR(st.st_mode)) {
+    AddDirectory(pattern);
+    return;
+  }
+#ifndef _WIN32
+  if (strpbrk(pattern, "*?[")) {
+    glob_t g;
+    if (glob(pattern, 0, NULL, &g) == 0) {
+      for (size_t i = 0; i < g.gl_pathc; i++) {
+        if (stat(g.gl_pathv[i], &st) == 0 && S_ISREG(st.st_mode)) {
+          AddJob(g.gl_pathv[i]);
+        }
+      }
+    }
+    globfree(&g);
+    return;
+  }
+#endif
+  AddJob(pattern);
+}
+
+static bool GetJob(const char *JobName, uint8_t JobMode) {
   struct stat st;
   FILE * f;
+  char entry[1024];
 
   if (stat(JobName, &st) == 0) {
-    if (st.st_size > 0 && st.st_size <= 33) {
+    if (st.st_size > 0 && st.st_size <= MAX_JOB_SIZE) {
       f = fopen(JobName, "r");
       if (f) {
-        fscanf(f, "%31s", szFilename);
+        while (fscanf(f, "%1023s", entry) == 1) {
+          if (JobMode == REC) {
+            AddRecJobs(entry);
+          } else {
+            AddJob(entry);
+          }
+        }
         fclose(f);
-        res = true; txcount = 0; rxcount = 0; fnlen = (int)strlen(szFilename)+1;
       }
     }
-    if (!res) {
+    if (job_count == 0) {
       unlink(JobName);  // clean up
+    } else {
+      job_mode = JobMode; job_next = 0;
+      // Whoever waits for this job's manifest mustn't find the last one.
+      unlink(JobMode == REC ? RecDoneName : SndDoneName);
     }
   }
-  return res;
+  return job_count > 0;
 }
 
-static uint32_t PCLink_RStat(const struct RISC_Serial *serial) {
+static void WriteManifest(const char *DoneName) {
+  char tmpname[64];
+  FILE *f;
+
+  snprintf(tmpname, sizeof(tmpname), "%s.tmp", DoneName);
+  f = fopen(tmpname, "w");
+  if (f) {
+    for (int i = 0; i < job_count; i++) {
+      if (jobs[i].result >= 0) {
+        fprintf(f, "ok %s %ld\n", jobs[i].path, jobs[i].result);
+      } else {
+        fprintf(f, "failed %s\n", jobs[i].path);
+      }
+    }
+    fclose(f);
+    rename(tmpname, DoneName);
+  }
+}
+
+// Called when the whole job file has been processed.
+static void FinishJob(void) {
+  WriteManifest(job_mode == REC ? RecDoneName : SndDoneName);
+  unlink(job_mode == REC ? RecName : SndName);
+  for (int i = 0; i < job_count; i++) {
+    free(jobs[i].path);
+  }
+  job_count = 0; job_next = 0; job_mode = 0;
+  job_pending = true;  // look for the next job right away
+}
+
+// Called when the transfer of the current file ends.
+static void EndTransfer(bool ok, long size) {
+  if (ok) {
+    jobs[job_next].result = size;
+  }
+  job_next++;
+  mode = 0;
+  if (job_next == job_count) {
+    FinishJob();  // the host may be waiting for the job file to disappear
+  }
+}
+
+static bool LoadFile(int fd, size_t size) {
+#ifndef _WIN32
+  if (size >= MMAP_THRESHOLD) {
+    void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      data = p; data_len = size; data_pos = 0; data_mapped = true;
+      return true;
+    }
+  }
+#endif
+  data = malloc(size ? size : 1);
+  if (!data) {
+    return false;
+  }
+  size_t n = 0;
+  while (n < size) {
+    ssize_t r = read(fd, data + n, size - n);
+    if (r <= 0) {
+      free(data); data = NULL;
+      return false;
+    }
+    n += (size_t)r;
+  }
+  data_len = size; data_pos = 0; data_mapped = false;
+  return true;
+}
+
+static void AppendData(const char *p, size_t len) {
+  if (data_len + len > data_cap) {
+    data_cap = data_cap ? data_cap * 2 : 64 * 1024;
+    data = realloc(data, data_cap);
+    if (!data) {
+      fprintf(stderr, "PCLink: out of memory\n");
+      exit(1);
+    }
+  }
+  memcpy(data + data_len, p, len);
+  data_len += len;
+}
+
+static void StoreFile(int fd) {
+  size_t n = 0;
+  while (n < data_len) {
+    ssize_t r = write(fd, data + n, data_len - n);
+    if (r <= 0) {
+      fprintf(stderr, "PCLink: can't write %s\n", szFilename);
+      break;
+    }
+    n += (size_t)r;
+  }
+}
+
+static void ReleaseData(void) {
+#ifndef _WIN32
+  if (data_mapped) {
+    munmap(data, data_len);
+    data = NULL;
+  }
+#endif
+  free(data);
+  data = NULL;
+  data_len = data_cap = data_pos = 0;
+  data_mapped = false;
+}
+
+static uint32_t host_millis(void) {
+#ifdef _WIN32
+  return (uint32_t)GetTickCount();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)ts.tv_sec * 1000 + (uint32_t)(ts.tv_nsec / 1000000);
+#endif
+}
+
+// Returns true if a job file may have appeared since the last call.
+// On Linux we watch the working directory with inotify and only report
+// a job after a matching event. Elsewhere (or if inotify isn't
+// available) we fall back to checking the job files periodically.
+static bool JobPending(void) {
+  if (!job_check_init) {
+    job_check_init = true;
+#ifdef __linux__
+    job_watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (job_watch != -1 &&
+        inotify_add_watch(job_watch, ".", IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+      close(job_watch);
+      job_watch = -1;
+    }
+#endif
+    job_check_time = host_millis();
+    return true;  // pick up jobs written before we started
+  }
+
+  uint32_t now = host_millis();
+  if (now - job_check_time < JOB_CHECK_INTERVAL) {
+    return job_pending;
+  }
+  job_check_time = now;
+
+#ifdef __linux__
+  if (job_watch != -1) {
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    while ((len = read(job_watch, events, sizeof(events))) > 0) {
+      for (char *p = events; p < events + len; ) {
+        const struct inotify_event *ev = (const struct inotify_event *)p;
+        if ((ev->mask & IN_Q_OVERFLOW) ||
+            (ev->len > 0 && (strcmp(ev->name, RecName) == 0 || strcmp(ev->name, SndName) == 0))) {
+          job_pending = true;
+        }
+        p += sizeof(struct inotify_event) + ev->len;
+      }
+    }
+    return job_pending;
+  }
+#endif
+  return true;
+}
+
+// Sets up the transfer of the next file in the job, returns false
+// if it can't be done.
+static bool StartTransfer(void) {
+  struct JobEntry *job = &jobs[job_next];
   struct stat st;
 
-  if (!mode) {
-    if (GetJob(RecName)) {
-      if (stat(szFilename, &st) == 0 && st.st_size >= 0 && st.st_size < 0x1000000) {
-        fd = open(szFilename, O_RDONLY);
-        if (fd != -1) {
+  if (!job->name[0]) {
+    return false;
+  }
+  strcpy(szFilename, job->name);
+  txcount = 0; rxcount = 0; fnlen = (int)strlen(szFilename)+1;
+  if (job_mode == REC) {
+    if (stat(job->path, &st) == 0 && st.st_size >= 0 && st.st_size < 0x1000000) {
+      fd = open(job->path, O_RDONLY);
+      if (fd != -1) {
+        if (LoadFile(fd, (size_t)st.st_size)) {
           flen = (int)st.st_size; mode = REC;
           printf("PCLink REC Filename: %s size %d\n", szFilename, flen);
         }
+        close(fd); fd = -1;
       }
-      if (!mode) {
-        unlink(RecName);  // clean up
-      }
-    } else if (GetJob(SndName)) {
-      fd = open(szFilename, O_CREAT|O_TRUNC|O_RDWR, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
-      if (fd != -1) {
-        flen = -1; mode = SND;
-        printf("PCLink SND Filename: %s\n", szFilename);
+    }
+  } else {
+    fd = open(job->path, O_CREAT|O_TRUNC|O_RDWR, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+    if (fd != -1) {
+      flen = -1; mode = SND;
+      printf("PCLink SND Filename: %s\n", szFilename);
+    }
+  }
+  return mode != 0;
+}
+
+static uint32_t PCLink_RStat(const struct RISC_Serial *serial) {
+  if (!mode) {
+    if (!job_mode && JobPending()) {
+      job_pending = false;
+      if (!GetJob(RecName, REC)) {
+        GetJob(SndName, SND);
       }
-      if (!mode) {
-        unlink(SndName);  // clean up
+    }
+    while (job_mode && !mode && job_next < job_count) {
+      if (!StartTransfer()) {
+        job_next++;
       }
     }
+    if (job_mode && !mode) {
+      FinishJob();
+    }
   }
   return 2 + (mode != 0);  // xmit always ready
 }
@@ -97,7 +414,8 @@ static uint32_t PCLink_RData(const struct RISC_Serial *serial) {
     } else if (mode == SND) {
       ch = ACK;
       if (flen == 0) {
-        mode = 0; unlink(SndName);
+        EndTransfer(true, (long)data_len);
+        ReleaseData();
       }
     } else {
       int pos = (rxcount - fnlen - 1) % 256;
@@ -107,11 +425,12 @@ static uint32_t PCLink_RData(const struct RISC_Serial *serial) {
         } else {
           ch = (uint8_t)flen;
           if (flen == 0) {
-            mode = 0; unlink(RecName);
+            EndTransfer(true, (long)data_len);
+            ReleaseData();
           }
         }
       } else {
-        read(fd, &ch, 1);
+        ch = data[data_pos++];
         flen--;
       }
     }
@@ -125,14 +444,14 @@ static void PCLink_TData(const struct RISC_Serial *serial, uint32_t value) {
   if (mode) {
     if (txcount == 0) {
       if (value != ACK) {
-        close(fd); fd = -1;
+        if (fd != -1) {
+          close(fd); fd = -1;
+        }
+        ReleaseData();
         if (mode == SND) {
-          unlink(szFilename);  // file not found, delete file created
-          unlink(SndName);  // clean up
-        } else {
-          unlink(RecName);  // clean up
+          unlink(jobs[job_next].path);  // file not found, delete file created
         }
-        mode = 0;
+        EndTransfer(false, 0);
       }
     } else if (mode == SND) {
       int lim;
@@ -141,9 +460,10 @@ static void PCLink_TData(const struct RISC_Serial *serial, uint32_t value) {
       buf[pos] = (uint8_t)value;
       lim = (unsigned char)buf[0];
       if (pos == lim) {
-        write(fd, buf+1, lim);
+        AppendData(buf+1, (size_t)lim);
         if (lim < 255) {
-          flen = 0; close(fd);
+          StoreFile(fd);
+          flen = 0; close(fd); fd = -1;
         }
       }
     }
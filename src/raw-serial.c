@@ -104,45 +104,102 @@ struct RISC_Serial *raw_serial_new(const char *filename_in, const char *filename
   return &s->serial;
 }
 
+struct RISC_Serial *raw_serial_listen(const char *address) {
+  fprintf(stderr, "Serial sockets are not supported on Windows, use --serial-in or --serial-out.\n");
+  return NULL;
+}
+
+void raw_serial_close(struct RISC_Serial *serial) {
+  struct RawSerial *s = (struct RawSerial *)serial;
+  CloseHandle(s->handle);
+  free(s);
+}
+
 #else  // _WIN32
 
+#define _POSIX_C_SOURCE 200809L
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <sys/select.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include "raw-serial.h"
+#include "socket-listen.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0  // we use SO_NOSIGPIPE instead
+#endif
+
+// Guest accesses to the serial port only touch these ring buffers. A
+// background thread moves data between them and the host files, so
+// that a guest polling the status register doesn't cost a system call
+// per poll. The thread blocks in poll() whenever it has nothing to do,
+// and the guest wakes it through a pipe when it changes a ring while
+// the thread is asleep.
+
+#define RING_SIZE 65536  // must be a power of two
+
+// While a pipe or terminal input is at end of file, retry reading it
+// this often (ms). Regular files and /dev/null stay at end of file.
+#define EOF_RETRY_INTERVAL 100
+
+// How long raw_serial_close waits for the output to accept what's left
+// in the ring (ms).
+#define CLOSE_TIMEOUT 1000
+
+// Listening sockets serve one client at a time. While no client is
+// connected, output is discarded.
+
+struct Ring {
+  uint8_t buf[RING_SIZE];
+  uint32_t head;  // advanced by the consumer
+  uint32_t tail;  // advanced by the producer
+};
 
 struct RawSerial {
   struct RISC_Serial serial;
   int fd_in;
   int fd_out;
+  int listen_fd;  // -1 unless we're a socket server
+  bool eof_is_final;
+  int wake_fd[2];
+  bool sleeping;
+  bool closing;
+  pthread_t thread;
+  struct Ring rx;
+  struct Ring tx;
 };
 
-static int max(int a, int b) {
-  return a > b ? a : b;
+static uint32_t load(const uint32_t *p) {
+  return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+static void store(uint32_t *p, uint32_t v) {
+  __atomic_store_n(p, v, __ATOMIC_SEQ_CST);
+}
+
+static void wake_thread(struct RawSerial *s) {
+  if (__atomic_load_n(&s->sleeping, __ATOMIC_SEQ_CST) &&
+      __atomic_exchange_n(&s->sleeping, false, __ATOMIC_SEQ_CST)) {
+    char c = 0;
+    write(s->wake_fd[1], &c, 1);
+  }
 }
 
 static uint32_t read_status(const struct RISC_Serial *serial) {
   struct RawSerial *s = (struct RawSerial *)serial;
-  struct timeval tv = { 0, 0 };
-  fd_set read_fds;
-  fd_set write_fds;
-  FD_ZERO(&read_fds);
-  FD_SET(s->fd_in, &read_fds);
-  FD_ZERO(&write_fds);
-  FD_SET(s->fd_out, &write_fds);
-  int nfds = max(s->fd_in, s->fd_out) + 1;
-  int r = select(nfds, &read_fds, &write_fds, NULL, &tv);
-  int status = 0;
-  if (r > 0) {
-    if (FD_ISSET(s->fd_in, &read_fds)) {
-      status |= 1;
-    }
-    if (FD_ISSET(s->fd_out, &write_fds)) {
-      status |= 2;
-    }
+  uint32_t status = 0;
+  if (load(&s->rx.tail) != s->rx.head) {
+    status |= 1;
+  }
+  if (s->tx.tail - load(&s->tx.head) < RING_SIZE) {
+    status |= 2;
   }
   return status;
 }
@@ -150,18 +207,211 @@ static uint32_t read_status(const struct RISC_Serial *serial) {
 static uint32_t read_data(const struct RISC_Serial *serial) {
   struct RawSerial *s = (struct RawSerial *)serial;
   uint8_t byte = 0;
-  read(s->fd_in, &byte, 1);
+  uint32_t head = s->rx.head;
+  if (load(&s->rx.tail) != head) {
+    byte = s->rx.buf[head & (RING_SIZE - 1)];
+    store(&s->rx.head, head + 1);
+    wake_thread(s);
+  }
   return byte;
 }
 
 static void write_data(const struct RISC_Serial *serial, uint32_t data) {
   struct RawSerial *s = (struct RawSerial *)serial;
-  uint8_t byte = (uint8_t)data;
-  write(s->fd_out, &byte, 1);
+  uint32_t tail = s->tx.tail;
+  if (tail - load(&s->tx.head) < RING_SIZE) {
+    s->tx.buf[tail & (RING_SIZE - 1)] = (uint8_t)data;
+    store(&s->tx.tail, tail + 1);
+    wake_thread(s);
+  }
+}
+
+static uint32_t min(uint32_t a, uint32_t b) {
+  return a < b ? a : b;
+}
+
+static void disconnect(struct RawSerial *s) {
+  close(s->fd_in);
+  s->fd_in = s->fd_out = -1;
+  fprintf(stderr, "Serial client disconnected.\n");
+}
+
+static void fill_rx(struct RawSerial *s, bool *eof) {
+  uint32_t tail = s->rx.tail;
+  uint32_t space = RING_SIZE - (tail - load(&s->rx.head));
+  uint32_t pos = tail & (RING_SIZE - 1);
+  ssize_t n = read(s->fd_in, &s->rx.buf[pos], min(space, RING_SIZE - pos));
+  if (s->listen_fd >= 0) {
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+      disconnect(s);
+      return;
+    }
+  } else {
+    *eof = n == 0;
+  }
+  if (n > 0) {
+    store(&s->rx.tail, tail + (uint32_t)n);
+  }
+}
+
+static void drain_tx(struct RawSerial *s) {
+  uint32_t head = s->tx.head;
+  uint32_t count = load(&s->tx.tail) - head;
+  uint32_t pos = head & (RING_SIZE - 1);
+  ssize_t n;
+  if (s->listen_fd >= 0) {
+    n = send(s->fd_out, &s->tx.buf[pos], min(count, RING_SIZE - pos), MSG_NOSIGNAL);
+    if (n < 0 && errno != EAGAIN && errno != EINTR) {
+      disconnect(s);
+      return;
+    }
+  } else {
+    n = write(s->fd_out, &s->tx.buf[pos], min(count, RING_SIZE - pos));
+    if (n < 0 && errno != EAGAIN && errno != EINTR) {
+      n = (ssize_t)min(count, RING_SIZE - pos);  // drop what we can't deliver
+    }
+  }
+  if (n > 0) {
+    store(&s->tx.head, head + (uint32_t)n);
+  }
+}
+
+static void set_nonblocking(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+static void accept_client(struct RawSerial *s) {
+  int fd = accept(s->listen_fd, NULL, NULL);
+  if (fd < 0) {
+    return;
+  }
+  set_nonblocking(fd);
+#ifdef SO_NOSIGPIPE
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+  s->fd_in = s->fd_out = fd;
+  fprintf(stderr, "Serial client connected.\n");
+}
+
+static void *io_thread(void *arg) {
+  struct RawSerial *s = arg;
+  bool eof = false;
+
+  for (;;) {
+    struct pollfd fds[3];
+    int nfds = 0;
+    bool connected = s->fd_in >= 0;
+    uint32_t rx_head = load(&s->rx.head);
+    uint32_t tx_tail = load(&s->tx.tail);
+    bool rx_space = s->rx.tail - rx_head < RING_SIZE;
+    bool tx_pending = tx_tail != s->tx.head;
+    bool closing = __atomic_load_n(&s->closing, __ATOMIC_SEQ_CST);
+
+    if (!connected && tx_pending) {
+      store(&s->tx.head, tx_tail);
+      tx_pending = false;
+    }
+    if (closing && !tx_pending) {
+      return NULL;
+    }
+
+    fds[nfds++] = (struct pollfd){ .fd = s->wake_fd[0], .events = POLLIN };
+    int in_idx = -1, out_idx = -1, listen_idx = -1;
+    if (!connected && !closing) {
+      listen_idx = nfds;
+      fds[nfds++] = (struct pollfd){ .fd = s->listen_fd, .events = POLLIN };
+    }
+    if (connected && rx_space && !eof && !closing) {
+      in_idx = nfds;
+      fds[nfds++] = (struct pollfd){ .fd = s->fd_in, .events = POLLIN };
+    }
+    if (connected && tx_pending) {
+      out_idx = nfds;
+      fds[nfds++] = (struct pollfd){ .fd = s->fd_out, .events = POLLOUT };
+    }
+
+    bool retry_eof = eof && rx_space && !s->eof_is_final && !closing;
+    int timeout = closing ? CLOSE_TIMEOUT : retry_eof ? EOF_RETRY_INTERVAL : -1;
+    __atomic_store_n(&s->sleeping, true, __ATOMIC_SEQ_CST);
+    // Re-check, the guest may have changed the rings before it could
+    // see that we're going to sleep.
+    if (load(&s->tx.tail) != tx_tail || load(&s->rx.head) != rx_head) {
+      __atomic_store_n(&s->sleeping, false, __ATOMIC_SEQ_CST);
+      continue;
+    }
+    int r = poll(fds, (nfds_t)nfds, timeout);
+    __atomic_store_n(&s->sleeping, false, __ATOMIC_SEQ_CST);
+    if (r < 0 && errno != EINTR) {
+      perror("Serial I/O thread");
+      return NULL;
+    }
+    if (closing && r == 0) {
+      return NULL;  // the output isn't taking any more
+    }
+
+    if (r > 0 && (fds[0].revents & POLLIN)) {
+      char drain[64];
+      read(s->wake_fd[0], drain, sizeof(drain));
+    }
+    if ((in_idx >= 0 && fds[in_idx].revents) || (retry_eof && r == 0)) {
+      fill_rx(s, &eof);
+    }
+    if (out_idx >= 0 && fds[out_idx].revents && s->fd_out >= 0) {
+      drain_tx(s);
+    }
+    if (listen_idx >= 0 && fds[listen_idx].revents) {
+      accept_client(s);
+    }
+  }
+}
+
+static struct RISC_Serial *start_serial(int fd_in, int fd_out, int listen_fd) {
+  struct RawSerial *s = calloc(1, sizeof(*s));
+  if (!s) {
+    return NULL;
+  }
+
+  s->serial = (struct RISC_Serial){
+    .read_status = &read_status,
+    .read_data = &read_data,
+    .write_data = &write_data
+  };
+  s->fd_in = fd_in;
+  s->fd_out = fd_out;
+  s->listen_fd = listen_fd;
+
+  // Once a regular file or /dev/null is at end of file, it stays there.
+  struct stat st, null_st;
+  if (fd_in >= 0 && fstat(fd_in, &st) == 0) {
+    s->eof_is_final = S_ISREG(st.st_mode) ||
+      (S_ISCHR(st.st_mode) && stat("/dev/null", &null_st) == 0 && st.st_rdev == null_st.st_rdev);
+  }
+
+  if (pipe(s->wake_fd) < 0) {
+    perror("Failed to create serial wakeup pipe");
+    goto fail1;
+  }
+  set_nonblocking(s->wake_fd[0]);
+  set_nonblocking(s->wake_fd[1]);
+
+  if (pthread_create(&s->thread, NULL, io_thread, s) != 0) {
+    fprintf(stderr, "Failed to start serial I/O thread\n");
+    goto fail2;
+  }
+  return &s->serial;
+
+ fail2:
+  close(s->wake_fd[0]);
+  close(s->wake_fd[1]);
+ fail1:
+  free(s);
+  return NULL;
 }
 
 struct RISC_Serial *raw_serial_new(const char *filename_in, const char *filename_out) {
   int fd_in, fd_out;
+  struct RISC_Serial *serial;
 
   fd_in = open(filename_in, O_RDONLY | O_NONBLOCK);
   if (fd_in < 0) {
@@ -175,21 +425,11 @@ struct RISC_Serial *raw_serial_new(const char *filename_in, const char *filename
     goto fail2;
   }
 
-  struct RawSerial *s = malloc(sizeof(*s));
-  if (!s) {
+  serial = start_serial(fd_in, fd_out, -1);
+  if (!serial) {
     goto fail3;
   }
-
-  *s = (struct RawSerial){
-    .serial = {
-      .read_status = &read_status,
-      .read_data = &read_data,
-      .write_data = &write_data
-    },
-    .fd_in = fd_in,
-    .fd_out = fd_out
-  };
-  return &s->serial;
+  return serial;
 
  fail3:
   close(fd_out);
@@ -199,4 +439,39 @@ struct RISC_Serial *raw_serial_new(const char *filename_in, const char *filename
   return NULL;
 }
 
+struct RISC_Serial *raw_serial_listen(const char *address) {
+  int fd = socket_listen(address);
+  if (fd < 0) {
+    return NULL;
+  }
+  set_nonblocking(fd);
+
+  struct RISC_Serial *serial = start_serial(-1, -1, fd);
+  if (!serial) {
+    close(fd);
+  }
+  return serial;
+}
+
+void raw_serial_close(struct RISC_Serial *serial) {
+  struct RawSerial *s = (struct RawSerial *)serial;
+  __atomic_store_n(&s->closing, true, __ATOMIC_SEQ_CST);
+  char c = 0;
+  write(s->wake_fd[1], &c, 1);
+  pthread_join(s->thread, NULL);
+
+  if (s->fd_in >= 0) {
+    close(s->fd_in);
+  }
+  if (s->fd_out >= 0 && s->fd_out != s->fd_in) {
+    close(s->fd_out);
+  }
+  if (s->listen_fd >= 0) {
+    close(s->listen_fd);
+  }
+  close(s->wake_fd[0]);
+  close(s->wake_fd[1]);
+  free(s);
+}
+
 #endif  // _WIN32
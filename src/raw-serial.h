@@ -5,4 +5,12 @@
 
 struct RISC_Serial *raw_serial_new(const char *filename_in, const char *filename_out);
 
+// Listens on a Unix domain socket ("PATH" or "unix:PATH") or a TCP port
+// ("tcp:PORT" on localhost, or "tcp:HOST:PORT"), one client at a time.
+struct RISC_Serial *raw_serial_listen(const char *address);
+
+// Writes out what the guest has sent, within a second, and releases
+// the port.
+void raw_serial_close(struct RISC_Serial *serial);
+
 #endif  // SERIAL_H
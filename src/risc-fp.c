@@ -1,5 +1,20 @@
 #include "risc-fp.h"
 
+// Number of leading zero bits, x must not be zero.
+static int clz32(uint32_t x) {
+#if defined(__GNUC__)
+  return __builtin_clz(x);
+#else
+  int n = 0;
+  if (x <= 0x0000FFFF) { n += 16; x <<= 16; }
+  if (x <= 0x00FFFFFF) { n += 8; x <<= 8; }
+  if (x <= 0x0FFFFFFF) { n += 4; x <<= 4; }
+  if (x <= 0x3FFFFFFF) { n += 2; x <<= 2; }
+  if (x <= 0x7FFFFFFF) { n += 1; }
+  return n;
+#endif
+}
+
 uint32_t fp_add(uint32_t x, uint32_t y, bool u, bool v) {
   bool xs = (x & 0x80000000) != 0;
   uint32_t xe;
@@ -41,10 +56,10 @@ uint32_t fp_add(uint32_t x, uint32_t y, bool u, bool v) {
   uint32_t e1 = e0 + 1;
   uint32_t t3 = s >> 1;
   if ((s & 0x3FFFFFC) != 0) {
-    while ((t3 & (1<<24)) == 0) {
-      t3 <<= 1;
-      e1--;
-    }
+    // Normalize so that bit 24 is the leading one (t3 < 1<<25).
+    int shift = clz32(t3) - 7;
+    t3 <<= shift;
+    e1 -= (uint32_t)shift;
   } else {
     t3 <<= 24;
     e1 -= 24;
@@ -131,18 +146,30 @@ struct idiv idiv(uint32_t x, uint32_t y, bool signed_div) {
   bool sign = ((int32_t)x < 0) & signed_div;
   uint32_t x0 = sign ? -x : x;
 
-  uint64_t RQ = x0;
-  for (int S = 0; S < 32; ++S) {
-    uint32_t w0 = (uint32_t)(RQ >> 31);
-    uint32_t w1 = w0 - y;
-    if ((int32_t)w1 < 0) {
-      RQ = ((uint64_t)w0 << 32) | ((RQ & 0x7FFFFFFFU) << 1);
-    } else {
-      RQ = ((uint64_t)w1 << 32) | ((RQ & 0x7FFFFFFFU) << 1) | 1;
+  // The emulator divides by positive divisors itself, so only zero and
+  // divisors of 2^31 and up normally get here.
+  struct idiv d;
+  if (y == 0) {
+    // Every trial subtraction "succeeds" until the last bit, where the
+    // partial remainder is x0 itself.
+    d.quot = ~(x0 >> 31);
+    d.rem = x0;
+  } else {
+    // Run the divider bit by bit. With y >= 2^31 the 32-bit
+    // subtraction wraps, and each quotient bit depends on the partial
+    // remainder left by every step before it.
+    uint32_t r = 0, q = 0;
+    for (int i = 31; i >= 0; i--) {
+      uint32_t w0 = (r << 1) | ((x0 >> i) & 1);
+      uint32_t w1 = w0 - y;
+      uint32_t bit = ~w1 >> 31;
+      r = bit ? w1 : w0;
+      q = (q << 1) | bit;
     }
+    d.quot = q;
+    d.rem = r;
   }
 
-  struct idiv d = { (uint32_t)RQ, (uint32_t)(RQ >> 32) };
   if (sign) {
     d.quot = -d.quot;
     if (d.rem) {
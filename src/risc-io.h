@@ -1,6 +1,7 @@
 #ifndef RISC_IO_H
 #define RISC_IO_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 struct RISC_Serial {
@@ -19,6 +20,23 @@ struct RISC_Clipboard {
   uint32_t (*read_control)(const struct RISC_Clipboard *);
   void (*write_data)(const struct RISC_Clipboard *, uint32_t);
   uint32_t (*read_data)(const struct RISC_Clipboard *);
+  // Optional: copies up to len bytes in the direction of the current
+  // transfer, returns the number of bytes copied.
+  uint32_t (*transfer)(const struct RISC_Clipboard *, uint8_t *, uint32_t);
+};
+
+struct RISC_HostFIFO {
+  uint32_t (*read_status)(const struct RISC_HostFIFO *);
+  void (*write_data)(const struct RISC_HostFIFO *, uint32_t);
+  void (*write_block)(const struct RISC_HostFIFO *, const uint8_t *, uint32_t);
+};
+
+// Called for every change of mouse or keyboard state, stamped with
+// the number of cycles run so far.
+struct RISC_InputLog {
+  void (*mouse_moved)(const struct RISC_InputLog *, uint64_t, int, int);
+  void (*mouse_button)(const struct RISC_InputLog *, uint64_t, int, bool);
+  void (*keyboard_input)(const struct RISC_InputLog *, uint64_t, const uint8_t *, uint32_t);
 };
 
 struct RISC_LED {
@@ -25,6 +25,8 @@
 #define ROMWords     512
 #define IOStart      0xFFFFFFC0
 
+#define KeyBufSize   4096  // must be a power of two
+
 
 struct RISC {
   uint32_t PC;
@@ -37,9 +39,11 @@ struct RISC {
 
   uint32_t progress;
   uint32_t current_tick;
+  uint64_t cycles;         // instructions retired, plus skipped idle time
+  uint32_t cycles_per_ms;  // virtual time if non-zero
   uint32_t mouse;
-  uint8_t  key_buf[16];
-  uint32_t key_cnt;
+  uint8_t  key_buf[KeyBufSize];
+  uint32_t key_head, key_tail;  // ring buffer indices, free running
   uint32_t switches;
 
   const struct RISC_LED *leds;
@@ -47,6 +51,8 @@ struct RISC {
   uint32_t spi_selected;
   const struct RISC_SPI *spi[4];
   const struct RISC_Clipboard *clipboard;
+  const struct RISC_HostFIFO *host_fifo;
+  const struct RISC_InputLog *input_log;
 
   int fb_width;   // words
   int fb_height;  // lines
@@ -71,6 +77,10 @@ static void risc_store_word(struct RISC *risc, uint32_t address, uint32_t value)
 static void risc_store_byte(struct RISC *risc, uint32_t address, uint8_t value);
 static uint32_t risc_load_io(struct RISC *risc, uint32_t address);
 static void risc_store_io(struct RISC *risc, uint32_t address, uint32_t value);
+static bool risc_get_block(struct RISC *risc, uint32_t descriptor, uint32_t size,
+                           uint32_t *adr, uint32_t *len);
+static void risc_host_fifo_block(struct RISC *risc, uint32_t descriptor);
+static void risc_clipboard_block(struct RISC *risc, uint32_t descriptor);
 
 static const uint32_t bootloader[ROMWords] = {
 #include "risc-boot.inc"
@@ -153,6 +163,14 @@ void risc_set_clipboard(struct RISC *risc, const struct RISC_Clipboard *clipboar
   risc->clipboard = clipboard;
 }
 
+void risc_set_host_fifo(struct RISC *risc, const struct RISC_HostFIFO *host_fifo) {
+  risc->host_fifo = host_fifo;
+}
+
+void risc_set_input_log(struct RISC *risc, const struct RISC_InputLog *input_log) {
+  risc->input_log = input_log;
+}
+
 void risc_set_switches(struct RISC *risc, int switches) {
   risc->switches = switches;
 }
@@ -161,15 +179,25 @@ void risc_reset(struct RISC *risc) {
   risc->PC = ROMStart/4;
 }
 
-void risc_run(struct RISC *risc, int cycles) {
+// Returns the number of instructions executed, which is less than
+// cycles if the cpu went idle.
+int risc_run(struct RISC *risc, int cycles) {
   risc->progress = 20;
   // The progress value is used to detect that the RISC cpu is busy
   // waiting on the millisecond counter or on the keyboard ready
   // bit. In that case it's better to just pause emulation until the
   // next frame.
-  for (int i = 0; i < cycles && risc->progress; i++) {
+  int i;
+  for (i = 0; i < cycles && risc->progress; i++) {
     risc_single_step(risc);
+    risc->cycles++;
+  }
+  // In virtual time, a slice always takes the same amount of time,
+  // even if we stopped early because the cpu was idle.
+  if (risc->cycles_per_ms) {
+    risc->cycles += (uint64_t)(cycles - i);
   }
+  return i;
 }
 
 static void risc_single_step(struct RISC *risc) {
@@ -254,20 +282,22 @@ static void risc_single_step(struct RISC *risc) {
         break;
       }
       case ADD: {
-        a_val = b_val + c_val;
+        uint64_t tmp = (uint64_t)b_val + c_val;
         if ((ir & ubit) != 0) {
-          a_val += risc->C;
+          tmp += risc->C;
         }
-        risc->C = a_val < b_val;
+        a_val = (uint32_t)tmp;
+        risc->C = (tmp >> 32) != 0;
         risc->V = ((a_val ^ c_val) & (a_val ^ b_val)) >> 31;
         break;
       }
       case SUB: {
-        a_val = b_val - c_val;
+        uint64_t tmp = (uint64_t)b_val - c_val;
         if ((ir & ubit) != 0) {
-          a_val -= risc->C;
+          tmp -= risc->C;
         }
-        risc->C = a_val > b_val;
+        a_val = (uint32_t)tmp;
+        risc->C = (tmp >> 32) != 0;
         risc->V = ((b_val ^ c_val) & (a_val ^ b_val)) >> 31;
         break;
       }
@@ -296,7 +326,7 @@ static void risc_single_step(struct RISC *risc) {
             risc->H = b_val % c_val;
           }
         } else {
-          struct idiv q = idiv(b_val, c_val, ir & ubit);
+          struct idiv q = idiv(b_val, c_val, (ir & ubit) == 0);
           a_val = q.quot;
           risc->H = q.rem;
         }
@@ -363,9 +393,9 @@ static void risc_single_step(struct RISC *risc) {
       default: abort();  // unreachable
     }
     if (t) {
-      if ((ir & vbit) != 0) {
-        risc_set_register(risc, 15, risc->PC * 4);
-      }
+      // The target register is read before the link is written, so
+      // BL R15 jumps to the old value.
+      uint32_t link = risc->PC * 4;
       if ((ir & ubit) == 0) {
         uint32_t c = ir & 0x0000000F;
         risc->PC = risc->R[c] / 4;
@@ -374,6 +404,9 @@ static void risc_single_step(struct RISC *risc) {
         off = (off ^ 0x00800000) - 0x00800000;  // sign-extend
         risc->PC = risc->PC + off;
       }
+      if ((ir & vbit) != 0) {
+        risc_set_register(risc, 15, link);
+      }
     }
   }
 }
@@ -444,7 +477,7 @@ static uint32_t risc_load_io(struct RISC *risc, uint32_t address) {
     case 0: {
       // Millisecond counter
       risc->progress--;
-      return risc->current_tick;
+      return risc_get_time(risc);
     }
     case 4: {
       // Switches
@@ -481,7 +514,7 @@ static uint32_t risc_load_io(struct RISC *risc, uint32_t address) {
     case 24: {
       // Mouse input / keyboard status
       uint32_t mouse = risc->mouse;
-      if (risc->key_cnt > 0) {
+      if (risc->key_tail != risc->key_head) {
         mouse |= 0x10000000;
       } else {
         risc->progress--;
@@ -490,11 +523,8 @@ static uint32_t risc_load_io(struct RISC *risc, uint32_t address) {
     }
     case 28: {
       // Keyboard input
-      if (risc->key_cnt > 0) {
-        uint8_t scancode = risc->key_buf[0];
-        risc->key_cnt--;
-        memmove(&risc->key_buf[0], &risc->key_buf[1], risc->key_cnt);
-        return scancode;
+      if (risc->key_tail != risc->key_head) {
+        return risc->key_buf[risc->key_head++ % KeyBufSize];
       }
       return 0;
     }
@@ -512,6 +542,14 @@ static uint32_t risc_load_io(struct RISC *risc, uint32_t address) {
       }
       return 0;
     }
+    case 48: {
+      // Host FIFO status
+      // Bit 0: ready (zero if there's no host FIFO)
+      if (risc->host_fifo) {
+        return risc->host_fifo->read_status(risc->host_fifo);
+      }
+      return 0;
+    }
     default: {
       return 0;
     }
@@ -565,7 +603,97 @@ static void risc_store_io(struct RISC *risc, uint32_t address, uint32_t value) {
       }
       break;
     }
+    case 56: {
+      // Clipboard block transfer, value is the address of a descriptor
+      if (risc->clipboard && risc->clipboard->transfer) {
+        risc_clipboard_block(risc, value);
+      }
+      break;
+    }
+    case 48: {
+      // Host FIFO data
+      if (risc->host_fifo) {
+        risc->host_fifo->write_data(risc->host_fifo, value);
+      }
+      break;
+    }
+    case 52: {
+      // Host FIFO block transfer, value is the address of a descriptor
+      if (risc->host_fifo) {
+        risc_host_fifo_block(risc, value);
+      }
+      break;
+    }
+  }
+}
+
+// Block transfer descriptors start with two words: the address of the
+// data in RAM and its length in bytes.
+static bool risc_get_block(struct RISC *risc, uint32_t descriptor, uint32_t size,
+                           uint32_t *adr, uint32_t *len) {
+  if (descriptor % 4 != 0 || descriptor > risc->mem_size - size) {
+    return false;
+  }
+  *adr = risc->RAM[descriptor/4];
+  *len = risc->RAM[descriptor/4 + 1];
+  return *adr <= risc->mem_size && *len <= risc->mem_size - *adr;
+}
+
+// A zero length flushes the FIFO.
+static void risc_host_fifo_block(struct RISC *risc, uint32_t descriptor) {
+  uint32_t adr, len;
+  if (!risc_get_block(risc, descriptor, 8, &adr, &len)) {
+    return;
+  }
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  uint8_t buf[1024];
+  do {
+    uint32_t n = len < sizeof(buf) ? len : (uint32_t)sizeof(buf);
+    for (uint32_t i = 0; i < n; i++) {
+      buf[i] = risc_load_byte(risc, adr + i);
+    }
+    risc->host_fifo->write_block(risc->host_fifo, buf, n);
+    adr += n;
+    len -= n;
+  } while (len > 0);
+#else
+  risc->host_fifo->write_block(risc->host_fifo, (const uint8_t *)risc->RAM + adr, len);
+#endif
+}
+
+// The third word of the descriptor receives the number of bytes copied.
+static void risc_clipboard_block(struct RISC *risc, uint32_t descriptor) {
+  const struct RISC_Clipboard *clip = risc->clipboard;
+  uint32_t adr, len, n;
+  if (!risc_get_block(risc, descriptor, 12, &adr, &len)) {
+    return;
+  }
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  uint8_t buf[1024];
+  n = 0;
+  while (n < len) {
+    uint32_t chunk = len - n < sizeof(buf) ? len - n : (uint32_t)sizeof(buf);
+    for (uint32_t i = 0; i < chunk; i++) {
+      buf[i] = risc_load_byte(risc, adr + n + i);
+    }
+    uint32_t done = clip->transfer(clip, buf, chunk);
+    for (uint32_t i = 0; i < done; i++) {
+      risc_store_byte(risc, adr + n + i, buf[i]);
+    }
+    n += done;
+    if (done < chunk) {
+      break;
+    }
+  }
+#else
+  n = clip->transfer(clip, (uint8_t *)risc->RAM + adr, len);
+  for (uint32_t a = adr & ~3u; a < adr + n; a += 4) {
+    if (a >= risc->display_start) {
+      risc_update_damage(risc, a/4 - risc->display_start/4);
+    }
   }
+#endif
+  risc->RAM[descriptor/4 + 2] = n;
 }
 
 
@@ -573,31 +701,67 @@ void risc_set_time(struct RISC *risc, uint32_t tick) {
   risc->current_tick = tick;
 }
 
+void risc_set_virtual_time(struct RISC *risc, uint32_t cycles_per_ms) {
+  risc->cycles_per_ms = cycles_per_ms;
+}
+
+uint32_t risc_get_time(struct RISC *risc) {
+  if (risc->cycles_per_ms) {
+    return (uint32_t)(risc->cycles / risc->cycles_per_ms);
+  }
+  return risc->current_tick;
+}
+
+uint64_t risc_get_cycles(struct RISC *risc) {
+  return risc->cycles;
+}
+
 void risc_mouse_moved(struct RISC *risc, int mouse_x, int mouse_y) {
+  uint32_t old = risc->mouse;
   if (mouse_x >= 0 && mouse_x < 4096) {
     risc->mouse = (risc->mouse & ~0x00000FFF) | mouse_x;
   }
   if (mouse_y >= 0 && mouse_y < 4096) {
     risc->mouse = (risc->mouse & ~0x00FFF000) | (mouse_y << 12);
   }
+  if (risc->input_log && risc->mouse != old) {
+    risc->input_log->mouse_moved(risc->input_log, risc->cycles,
+                                 risc->mouse & 0xFFF, (risc->mouse >> 12) & 0xFFF);
+  }
 }
 
 void risc_mouse_button(struct RISC *risc, int button, bool down) {
   if (button >= 1 && button < 4) {
+    uint32_t old = risc->mouse;
     uint32_t bit = 1 << (27 - button);
     if (down) {
       risc->mouse |= bit;
     } else {
       risc->mouse &= ~bit;
     }
+    if (risc->input_log && risc->mouse != old) {
+      risc->input_log->mouse_button(risc->input_log, risc->cycles, button, down);
+    }
   }
 }
 
-void risc_keyboard_input(struct RISC *risc, uint8_t *scancodes, uint32_t len) {
-  if (sizeof(risc->key_buf) - risc->key_cnt >= len) {
-    memmove(&risc->key_buf[risc->key_cnt], scancodes, len);
-    risc->key_cnt += len;
+// Either queues all of the scancodes or, if there's not enough room,
+// none of them.
+bool risc_keyboard_input(struct RISC *risc, const uint8_t *scancodes, uint32_t len) {
+  if (len > risc_keyboard_space(risc)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < len; i++) {
+    risc->key_buf[risc->key_tail++ % KeyBufSize] = scancodes[i];
   }
+  if (risc->input_log && len > 0) {
+    risc->input_log->keyboard_input(risc->input_log, risc->cycles, scancodes, len);
+  }
+  return true;
+}
+
+uint32_t risc_keyboard_space(struct RISC *risc) {
+  return KeyBufSize - (risc->key_tail - risc->key_head);
 }
 
 uint32_t *risc_get_framebuffer_ptr(struct RISC *risc) {
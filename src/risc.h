@@ -21,14 +21,20 @@ void risc_set_leds(struct RISC *risc, const struct RISC_LED *leds);
 void risc_set_serial(struct RISC *risc, const struct RISC_Serial *serial);
 void risc_set_spi(struct RISC *risc, int index, const struct RISC_SPI *spi);
 void risc_set_clipboard(struct RISC *risc, const struct RISC_Clipboard *clipboard);
+void risc_set_host_fifo(struct RISC *risc, const struct RISC_HostFIFO *host_fifo);
+void risc_set_input_log(struct RISC *risc, const struct RISC_InputLog *input_log);
 void risc_set_switches(struct RISC *risc, int switches);
 
 void risc_reset(struct RISC *risc);
-void risc_run(struct RISC *risc, int cycles);
+int risc_run(struct RISC *risc, int cycles);
 void risc_set_time(struct RISC *risc, uint32_t tick);
+void risc_set_virtual_time(struct RISC *risc, uint32_t cycles_per_ms);
+uint32_t risc_get_time(struct RISC *risc);
+uint64_t risc_get_cycles(struct RISC *risc);
 void risc_mouse_moved(struct RISC *risc, int mouse_x, int mouse_y);
 void risc_mouse_button(struct RISC *risc, int button, bool down);
-void risc_keyboard_input(struct RISC *risc, uint8_t *scancodes, uint32_t len);
+bool risc_keyboard_input(struct RISC *risc, const uint8_t *scancodes, uint32_t len);
+uint32_t risc_keyboard_space(struct RISC *risc);
 
 uint32_t *risc_get_framebuffer_ptr(struct RISC *risc);
 struct Damage risc_get_framebuffer_damage(struct RISC *risc);
@@ -0,0 +1,249 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "screen-log.h"
+
+// Records what the screen shows, for watching a session later or
+// comparing runs. tools/screenrec.rs turns recordings into GIFs or raw
+// video.
+//
+// File format: the magic string, the width and height, and a list of
+// frames. Numbers are LEB128 encoded as in input logs, framebuffer
+// words are 4 bytes little endian.
+//
+//   'F' time run... 0 0     a frame
+//   'E' time                end of recording
+//
+// Times are milliseconds of guest time since the previous entry. Words
+// are numbered as they are stored, lines bottom up, and a frame lists
+// those that changed. Each run is the number of words to skip, then
+// count * 2 + fill and either one word repeated count times (fill) or
+// count words.
+//
+// The emulator thread only copies the damaged words. Comparing them to
+// the last frame, encoding and writing happen on a background thread.
+// If that falls behind, frames are merged instead of the emulator
+// having to wait.
+
+#define MAGIC "OSCREEN1"
+#define MIN_FILL 3  // words
+
+struct ScreenRecorder {
+  FILE *file;
+  int words_per_line;
+  int height;
+  pthread_t thread;
+  uint32_t end_time;
+  bool first;
+
+  // Shared with the writer thread.
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  uint32_t *pending;
+  struct Damage pending_damage;
+  uint32_t pending_time;
+  bool closing;
+
+  // Writer thread only.
+  uint32_t *current;
+  uint32_t *previous;
+  uint32_t last_time;
+  bool frame_started;
+  size_t pos;  // of the next word in the frame
+};
+
+static void put_number(FILE *f, uint64_t n) {
+  while (n >= 0x80) {
+    putc((int)(n & 0x7F) | 0x80, f);
+    n >>= 7;
+  }
+  putc((int)n, f);
+}
+
+static void put_word(FILE *f, uint32_t w) {
+  putc((int)(w & 0xFF), f);
+  putc((int)(w >> 8 & 0xFF), f);
+  putc((int)(w >> 16 & 0xFF), f);
+  putc((int)(w >> 24), f);
+}
+
+static void put_run(struct ScreenRecorder *rec, size_t start, size_t count, bool fill, uint32_t time) {
+  if (!rec->frame_started) {
+    putc('F', rec->file);
+    put_number(rec->file, time - rec->last_time);
+    rec->last_time = time;
+    rec->frame_started = true;
+  }
+  put_number(rec->file, start - rec->pos);
+  put_number(rec->file, count * 2 + fill);
+  if (fill) {
+    put_word(rec->file, rec->current[start]);
+  } else {
+    for (size_t i = start; i < start + count; i++) {
+      put_word(rec->file, rec->current[i]);
+    }
+  }
+  rec->pos = start + count;
+}
+
+// Writes words [start, end), which all changed.
+static void put_span(struct ScreenRecorder *rec, size_t start, size_t end, uint32_t time) {
+  const uint32_t *w = rec->current;
+  size_t literal = start;
+  size_t i = start;
+  while (i < end) {
+    size_t j = i + 1;
+    while (j < end && w[j] == w[i]) {
+      j++;
+    }
+    if (j - i >= MIN_FILL) {
+      if (literal < i) {
+        put_run(rec, literal, i - literal, false, time);
+      }
+      put_run(rec, i, j - i, true, time);
+      literal = j;
+    }
+    i = j;
+  }
+  if (literal < end) {
+    put_run(rec, literal, end - literal, false, time);
+  }
+}
+
+static void write_frame(struct ScreenRecorder *rec, const struct Damage *d, uint32_t time) {
+  rec->frame_started = false;
+  rec->pos = 0;
+  for (int line = d->y1; line <= d->y2; line++) {
+    size_t row = (size_t)line * (size_t)rec->words_per_line;
+    size_t span = 0;
+    bool in_span = false;
+    for (size_t i = row + (size_t)d->x1; i <= row + (size_t)d->x2; i++) {
+      bool changed = rec->current[i] != rec->previous[i];
+      if (changed && !in_span) {
+        span = i;
+        in_span = true;
+      } else if (!changed && in_span) {
+        put_span(rec, span, i, time);
+        in_span = false;
+      }
+    }
+    if (in_span) {
+      put_span(rec, span, row + (size_t)d->x2 + 1, time);
+    }
+    memcpy(&rec->previous[row + (size_t)d->x1], &rec->current[row + (size_t)d->x1],
+           (size_t)(d->x2 - d->x1 + 1) * 4);
+  }
+  if (rec->frame_started) {
+    put_number(rec->file, 0);
+    put_number(rec->file, 0);
+  }
+}
+
+static void *writer_thread(void *arg) {
+  struct ScreenRecorder *rec = arg;
+  for (;;) {
+    pthread_mutex_lock(&rec->lock);
+    while (rec->pending_damage.y1 > rec->pending_damage.y2 && !rec->closing) {
+      pthread_cond_wait(&rec->cond, &rec->lock);
+    }
+    struct Damage d = rec->pending_damage;
+    uint32_t time = rec->pending_time;
+    if (d.y1 > d.y2) {
+      pthread_mutex_unlock(&rec->lock);
+      break;
+    }
+    for (int line = d.y1; line <= d.y2; line++) {
+      size_t start = (size_t)line * (size_t)rec->words_per_line + (size_t)d.x1;
+      memcpy(&rec->current[start], &rec->pending[start], (size_t)(d.x2 - d.x1 + 1) * 4);
+    }
+    rec->pending_damage = (struct Damage){ .x1 = 0, .x2 = -1, .y1 = 0, .y2 = -1 };
+    pthread_mutex_unlock(&rec->lock);
+
+    write_frame(rec, &d, time);
+  }
+  return NULL;
+}
+
+struct ScreenRecorder *screen_recorder_new(const char *filename, int width, int height) {
+  struct ScreenRecorder *rec = calloc(1, sizeof(*rec));
+  rec->file = fopen(filename, "wb");
+  if (!rec->file) {
+    fprintf(stderr, "Can't create screen recording %s: %s\n", filename, strerror(errno));
+    exit(1);
+  }
+  setvbuf(rec->file, NULL, _IOFBF, 1 << 20);
+  rec->words_per_line = width / 32;
+  rec->height = height;
+  rec->first = true;
+  size_t words = (size_t)rec->words_per_line * (size_t)height;
+  rec->pending = calloc(words, 4);
+  rec->current = calloc(words, 4);
+  rec->previous = calloc(words, 4);
+  rec->pending_damage = (struct Damage){ .x1 = 0, .x2 = -1, .y1 = 0, .y2 = -1 };
+  fputs(MAGIC, rec->file);
+  put_number(rec->file, (uint64_t)width);
+  put_number(rec->file, (uint64_t)height);
+
+  pthread_mutex_init(&rec->lock, NULL);
+  pthread_cond_init(&rec->cond, NULL);
+  if (pthread_create(&rec->thread, NULL, writer_thread, rec) != 0) {
+    fprintf(stderr, "Can't start the screen recording thread\n");
+    exit(1);
+  }
+  return rec;
+}
+
+void screen_recorder_frame(struct ScreenRecorder *rec, struct RISC *risc, const struct Damage *damage) {
+  rec->end_time = risc_get_time(risc);
+  struct Damage d = *damage;
+  if (rec->first) {
+    // Start with everything.
+    d = (struct Damage){ .x1 = 0, .x2 = rec->words_per_line - 1, .y1 = 0, .y2 = rec->height - 1 };
+    rec->first = false;
+  }
+  if (d.y1 > d.y2) {
+    return;
+  }
+
+  const uint32_t *fb = risc_get_framebuffer_ptr(risc);
+  pthread_mutex_lock(&rec->lock);
+  for (int line = d.y1; line <= d.y2; line++) {
+    size_t start = (size_t)line * (size_t)rec->words_per_line + (size_t)d.x1;
+    memcpy(&rec->pending[start], &fb[start], (size_t)(d.x2 - d.x1 + 1) * 4);
+  }
+  struct Damage *p = &rec->pending_damage;
+  if (p->y1 > p->y2) {
+    *p = d;
+  } else {
+    p->x1 = d.x1 < p->x1 ? d.x1 : p->x1;
+    p->x2 = d.x2 > p->x2 ? d.x2 : p->x2;
+    p->y1 = d.y1 < p->y1 ? d.y1 : p->y1;
+    p->y2 = d.y2 > p->y2 ? d.y2 : p->y2;
+  }
+  rec->pending_time = rec->end_time;
+  pthread_cond_signal(&rec->cond);
+  pthread_mutex_unlock(&rec->lock);
+}
+
+void screen_recorder_close(struct ScreenRecorder *rec) {
+  pthread_mutex_lock(&rec->lock);
+  rec->closing = true;
+  pthread_cond_signal(&rec->cond);
+  pthread_mutex_unlock(&rec->lock);
+  pthread_join(rec->thread, NULL);
+
+  putc('E', rec->file);
+  put_number(rec->file, rec->end_time - rec->last_time);
+  if (fclose(rec->file) != 0) {
+    perror("Can't write screen recording");
+  }
+  pthread_mutex_destroy(&rec->lock);
+  pthread_cond_destroy(&rec->cond);
+  free(rec->pending);
+  free(rec->current);
+  free(rec->previous);
+  free(rec);
+}
@@ -0,0 +1,12 @@
+#ifndef SCREEN_LOG_H
+#define SCREEN_LOG_H
+
+#include "risc.h"
+
+struct ScreenRecorder;
+
+struct ScreenRecorder *screen_recorder_new(const char *filename, int width, int height);
+void screen_recorder_frame(struct ScreenRecorder *rec, struct RISC *risc, const struct Damage *damage);
+void screen_recorder_close(struct ScreenRecorder *rec);
+
+#endif  // SCREEN_LOG_H
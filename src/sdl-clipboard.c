@@ -1,4 +1,6 @@
+#include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <SDL.h>
@@ -11,36 +13,64 @@ static char *data = NULL;
 static size_t data_ptr = 0;
 static size_t data_len = 0;
 
+// The host clipboard text, with line endings converted to CR. It's
+// fetched on the first paste and kept until the clipboard changes.
+static char *cache = NULL;
+static size_t cache_len = 0;
+static bool cache_valid = false;
+
 static void reset() {
+  if (state == PUT) {
+    free(data);
+  }
   state = IDLE;
-  free(data);
   data = NULL;
   data_len = 0;
   data_ptr = 0;
 }
 
-static uint32_t clipboard_control_read(const struct RISC_Clipboard *clip) {
-  uint32_t r = 0;
-  reset();
-  data = SDL_GetClipboardText();
-  if (data) {
-    data_len = strlen(data);
-    if (data_len > UINT32_MAX) {
-      reset();
-    }
-    else if (data_len > 0) {
-      state = GET;
-      r = (uint32_t)data_len;
-      // Decrease length if data contains CR/LF line endings
-      const char *p = data;
-      while ((p = strchr(p, '\r')) != NULL) {
-        if (*++p == '\n') {
-          r--;
-        }
+static void set_cache(char *text, size_t len) {
+  free(cache);
+  cache = text;
+  cache_len = len;
+  cache_valid = true;
+}
+
+static void fetch_clipboard() {
+  char *text = SDL_GetClipboardText();
+  size_t len = 0;
+  char *norm = NULL;
+  if (text) {
+    norm = malloc(strlen(text) + 1);
+  }
+  if (norm) {
+    for (const char *p = text; *p; p++) {
+      if (*p == '\r' && p[1] == '\n') {
+        continue;
       }
+      norm[len++] = *p == '\n' ? '\r' : *p;
     }
   }
-  return r;
+  SDL_free(text);
+  set_cache(norm, len);
+}
+
+void sdl_clipboard_changed(void) {
+  cache_valid = false;
+}
+
+static uint32_t clipboard_control_read(const struct RISC_Clipboard *clip) {
+  reset();
+  if (!cache_valid) {
+    fetch_clipboard();
+  }
+  if (cache_len > 0 && cache_len < UINT32_MAX) {
+    state = GET;
+    data = cache;
+    data_len = cache_len;
+    return (uint32_t)data_len;
+  }
+  return 0;
 }
 
 static void clipboard_control_write(const struct RISC_Clipboard *clip, uint32_t len) {
@@ -55,17 +85,32 @@ static void clipboard_control_write(const struct RISC_Clipboard *clip, uint32_t
   }
 }
 
+static void put_done() {
+  // Oberon text uses CR line endings, the host gets LF.
+  size_t len = data_len;
+  char *copy = malloc(len + 1);
+  if (copy) {
+    memcpy(copy, data, len);
+  }
+  for (size_t i = 0; i < data_len; i++) {
+    if (data[i] == '\r') {
+      data[i] = '\n';
+    }
+  }
+  data[data_len] = 0;
+  SDL_SetClipboardText(data);
+  reset();
+  if (copy) {
+    set_cache(copy, len);
+  }
+}
+
 static uint32_t clipboard_data_read(const struct RISC_Clipboard *clip) {
   uint32_t result = 0;
   if (state == GET) {
     assert(data && data_ptr < data_len);
     result = (uint8_t)data[data_ptr];
     data_ptr++;
-    if (result == '\r' && data[data_ptr] == '\n') {
-      data_ptr++;
-    } else if (result == '\n') {
-      result = '\r';
-    }
     if (data_ptr == data_len) {
       reset();
     }
@@ -76,22 +121,41 @@ static uint32_t clipboard_data_read(const struct RISC_Clipboard *clip) {
 static void clipboard_data_write(const struct RISC_Clipboard *clip, uint32_t c) {
   if (state == PUT) {
     assert(data && data_ptr < data_len);
-    if ((char)c == '\r') {
-      c = '\n';
-    }
     data[data_ptr] = (char)c;
     ++data_ptr;
     if (data_ptr == data_len) {
-      data[data_ptr] = 0;
-      SDL_SetClipboardText(data);
+      put_done();
+    }
+  }
+}
+
+static uint32_t clipboard_transfer(const struct RISC_Clipboard *clip, uint8_t *buf, uint32_t len) {
+  size_t n = data_len - data_ptr;
+  if (n > len) {
+    n = len;
+  }
+  if (state == GET) {
+    memcpy(buf, data + data_ptr, n);
+  } else if (state == PUT) {
+    memcpy(data + data_ptr, buf, n);
+  } else {
+    return 0;
+  }
+  data_ptr += n;
+  if (data_ptr == data_len) {
+    if (state == PUT) {
+      put_done();
+    } else {
       reset();
     }
   }
+  return (uint32_t)n;
 }
 
 const struct RISC_Clipboard sdl_clipboard = {
   .write_control = clipboard_control_write,
   .read_control = clipboard_control_read,
   .write_data = clipboard_data_write,
-  .read_data = clipboard_data_read
+  .read_data = clipboard_data_read,
+  .transfer = clipboard_transfer
 };
@@ -5,4 +5,7 @@
 
 extern const struct RISC_Clipboard sdl_clipboard;
 
+// Call when the host clipboard may have changed.
+void sdl_clipboard_changed(void);
+
 #endif  // SDL_CLIPBOARD_H
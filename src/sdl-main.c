@@ -14,6 +14,11 @@
 #include "raw-serial.h"
 #include "sdl-ps2.h"
 #include "sdl-clipboard.h"
+#include "host-fifo.h"
+#include "input-log.h"
+#include "pacing.h"
+#include "fb-export.h"
+#include "screen-log.h"
 
 #define CPU_HZ 25000000
 #define FPS 60
@@ -28,10 +33,15 @@ static uint32_t BLACK = 0x657b83, WHITE = 0xfdf6e3;
 
 static int best_display(const SDL_Rect *rect);
 static int clamp(int x, int min, int max);
+static double host_ms(void);
 static enum Action map_keyboard_event(SDL_KeyboardEvent *event);
 static void show_leds(const struct RISC_LED *leds, uint32_t value);
 static double scale_display(SDL_Window *window, const SDL_Rect *risc_rect, SDL_Rect *display_rect);
-static void update_texture(struct RISC *risc, SDL_Texture *texture, const SDL_Rect *risc_rect);
+static SDL_Texture *create_texture(SDL_Renderer *renderer, const SDL_Rect *risc_rect);
+static bool update_texture(struct RISC *risc, SDL_Texture *texture, const SDL_Rect *risc_rect,
+                           const struct Damage *damage);
+static void render_display(SDL_Renderer *renderer, SDL_Texture *texture, const SDL_Rect *display_rect);
+static char *read_text_file(const char *filename);
 
 enum Action {
   ACTION_OBERON_INPUT,
@@ -69,7 +79,20 @@ static struct option long_options[] = {
   { "size",             required_argument, NULL, 's' },
   { "serial-in",        required_argument, NULL, 'I' },
   { "serial-out",       required_argument, NULL, 'O' },
+  { "serial-socket",    required_argument, NULL, 'U' },
   { "boot-from-serial", no_argument,       NULL, 'S' },
+  { "disk-trace",       required_argument, NULL, 'T' },
+  { "ram-disk",         optional_argument, NULL, 'r' },
+  { "ram-disk-save",    required_argument, NULL, 'w' },
+  { "host-fifo",        required_argument, NULL, 'H' },
+  { "type",             required_argument, NULL, 't' },
+  { "virtual-time",     required_argument, NULL, 'V' },
+  { "record",           required_argument, NULL, 'R' },
+  { "replay",           required_argument, NULL, 'P' },
+  { "fps",              required_argument, NULL, 'F' },
+  { "speed",            required_argument, NULL, 'C' },
+  { "shm",              required_argument, NULL, 'M' },
+  { "record-screen",    required_argument, NULL, 'G' },
   { NULL,               no_argument,       NULL, 0   }
 };
 
@@ -94,6 +117,24 @@ static void usage() {
        "  --boot-from-serial    Boot from serial line (disk image not required)\n"
        "  --serial-in FILE      Read serial input from FILE\n"
        "  --serial-out FILE     Write serial output to FILE\n"
+       "  --serial-socket ADDR  Accept serial connections on a Unix socket\n"
+       "                        (PATH) or TCP port (tcp:[HOST:]PORT)\n"
+       "  --disk-trace FILE     Record disk commands to FILE\n"
+       "  --ram-disk[=IMAGE]    Attach a RAM disk as second drive, optionally\n"
+       "                        seeded from IMAGE\n"
+       "  --ram-disk-save FILE  Save the RAM disk to FILE on exit\n"
+       "  --host-fifo FILE      Write the guest's host FIFO output to FILE\n"
+       "                        (- for stdout)\n"
+       "  --type FILE           Type the contents of FILE on the keyboard\n"
+       "                        (- for stdin)\n"
+       "  --fps N               Target frame rate (default 60)\n"
+       "  --speed MHZ           Emulated CPU speed (default 25)\n"
+       "  --virtual-time MHZ    Like --speed, and derive the guest clock from\n"
+       "                        instructions run\n"
+       "  --record FILE         Record mouse and keyboard input to FILE\n"
+       "  --replay FILE         Play back input recorded with --record\n"
+       "  --shm NAME            Export the framebuffer in shared memory NAME\n"
+       "  --record-screen FILE  Record the screen to FILE (see tools/screenrec)\n"
        );
   exit(1);
 }
@@ -117,10 +158,26 @@ int main (int argc, char *argv[]) {
   int mem_option = 0;
   const char *serial_in = NULL;
   const char *serial_out = NULL;
+  const char *serial_socket = NULL;
+  struct RISC_Serial *raw_serial = NULL;
   bool boot_from_serial = false;
+  const char *disk_trace_file = NULL;
+  bool ram_disk = false;
+  const char *ram_disk_image = NULL;
+  const char *ram_disk_save = NULL;
+  struct RISC_HostFIFO *host_fifo = NULL;
+  char *typing = NULL;
+  const char *typing_pos = NULL;
+  int fps = FPS;
+  uint32_t cycles_per_ms = CPU_HZ / 1000;
+  bool virtual_time = false;
+  const char *record_file = NULL;
+  struct InputPlayer *player = NULL;
+  const char *shm_name = NULL;
+  const char *screen_file = NULL;
 
   int opt;
-  while ((opt = getopt_long(argc, argv, "z:fLm:s:I:O:S", long_options, NULL)) != -1) {
+  while ((opt = getopt_long(argc, argv, "z:fLm:s:I:O:U:ST:r::w:H:t:V:R:P:F:C:M:G:", long_options, NULL)) != -1) {
     switch (opt) {
       case 'z': {
         double x = strtod(optarg, 0);
@@ -161,11 +218,72 @@ int main (int argc, char *argv[]) {
         serial_out = optarg;
         break;
       }
+      case 'U': {
+        serial_socket = optarg;
+        break;
+      }
       case 'S': {
         boot_from_serial = true;
         risc_set_switches(risc, 1);
         break;
       }
+      case 'T': {
+        disk_trace_file = optarg;
+        break;
+      }
+      case 'r': {
+        ram_disk = true;
+        ram_disk_image = optarg;
+        break;
+      }
+      case 'w': {
+        ram_disk = true;
+        ram_disk_save = optarg;
+        break;
+      }
+      case 'H': {
+        host_fifo = host_fifo_new(optarg);
+        risc_set_host_fifo(risc, host_fifo);
+        break;
+      }
+      case 't': {
+        typing = read_text_file(optarg);
+        typing_pos = typing;
+        break;
+      }
+      case 'V':
+      case 'C': {
+        double mhz = strtod(optarg, 0);
+        if (!(mhz >= 1 && mhz <= 1000)) {
+          usage();
+        }
+        cycles_per_ms = (uint32_t)(mhz * 1000);
+        virtual_time |= opt == 'V';
+        break;
+      }
+      case 'M': {
+        shm_name = optarg;
+        break;
+      }
+      case 'G': {
+        screen_file = optarg;
+        break;
+      }
+      case 'F': {
+        fps = atoi(optarg);
+        if (fps < 1 || fps > 1000) {
+          usage();
+        }
+        break;
+      }
+      case 'R': {
+        record_file = optarg;
+        break;
+      }
+      case 'P': {
+        player = input_player_new(optarg);
+        break;
+      }
       default: {
         usage();
       }
@@ -175,24 +293,70 @@ int main (int argc, char *argv[]) {
   if (mem_option || size_option) {
     risc_configure_memory(risc, mem_option, risc_rect.w, risc_rect.h);
   }
+  struct FBExport *fb_export = NULL;
+  if (shm_name) {
+    fb_export = fb_export_new(shm_name, risc_rect.w, risc_rect.h);
+  }
+  struct ScreenRecorder *screen_recorder = NULL;
+  if (screen_file) {
+    screen_recorder = screen_recorder_new(screen_file, risc_rect.w, risc_rect.h);
+  }
 
+  int cycles_per_frame = (int)(cycles_per_ms * 1000 / fps);
+  if (player) {
+    // Play back with the clock settings of the recording, or the
+    // input ends up on different instructions.
+    virtual_time = input_player_cycles_per_ms(player) != 0;
+    if (virtual_time) {
+      cycles_per_ms = input_player_cycles_per_ms(player);
+    }
+    cycles_per_frame = (int)input_player_cycles_per_frame(player);
+  }
+  risc_set_virtual_time(risc, virtual_time ? cycles_per_ms : 0);
+  struct RISC_InputLog *recorder = NULL;
+  if (record_file) {
+    recorder = input_recorder_new(record_file, virtual_time ? cycles_per_ms : 0, (uint32_t)cycles_per_frame);
+    risc_set_input_log(risc, recorder);
+  }
+  // Input is fed between slices, so their length must not change
+  // while recording or replaying.
+  struct Pacing *pacing = pacing_new(cycles_per_ms, fps, record_file || player ? cycles_per_frame : 0);
+
+  struct RISC_SPI *disk = NULL;
   if (optind == argc - 1) {
-    risc_set_spi(risc, 1, disk_new(argv[optind]));
+    disk = disk_new(argv[optind]);
   } else if (optind == argc && boot_from_serial) {
     /* Allow diskless boot */
-    risc_set_spi(risc, 1, disk_new(NULL));
+    disk = disk_new(NULL);
   } else {
     usage();
   }
+  if (disk_trace_file) {
+    disk_trace(disk, disk_trace_file);
+  }
+  risc_set_spi(risc, 1, disk);
+
+  struct RISC_SPI *ram_disk_spi = NULL;
+  if (ram_disk) {
+    ram_disk_spi = disk_new_ram(ram_disk_image);
+    risc_set_spi(risc, 2, ram_disk_spi);
+  }
 
-  if (serial_in || serial_out) {
+  if (serial_socket) {
+    if (serial_in || serial_out) {
+      fail(1, "--serial-socket can't be combined with --serial-in or --serial-out");
+    }
+    raw_serial = raw_serial_listen(serial_socket);
+    risc_set_serial(risc, raw_serial);
+  } else if (serial_in || serial_out) {
     if (!serial_in) {
       serial_in = "/dev/null";
     }
     if (!serial_out) {
       serial_out = "/dev/null";
     }
-    risc_set_serial(risc, raw_serial_new(serial_in, serial_out));
+    raw_serial = raw_serial_new(serial_in, serial_out);
+    risc_set_serial(risc, raw_serial);
   }
 
   if (SDL_Init(SDL_INIT_VIDEO) != 0) {
@@ -233,30 +397,30 @@ int main (int argc, char *argv[]) {
     fail(1, "Could not create renderer: %s", SDL_GetError());
   }
 
-  SDL_Texture *texture = SDL_CreateTexture(renderer,
-                                           SDL_PIXELFORMAT_ARGB8888,
-                                           SDL_TEXTUREACCESS_STREAMING,
-                                           risc_rect.w,
-                                           risc_rect.h);
-  if (texture == NULL) {
-    fail(1, "Could not create texture: %s", SDL_GetError());
-  }
+  SDL_Texture *texture = create_texture(renderer, &risc_rect);
 
   SDL_Rect display_rect;
   double display_scale = scale_display(window, &risc_rect, &display_rect);
-  update_texture(risc, texture, &risc_rect);
+  struct Damage damage = risc_get_framebuffer_damage(risc);
+  update_texture(risc, texture, &risc_rect, &damage);
   SDL_ShowWindow(window);
-  SDL_RenderClear(renderer);
-  SDL_RenderCopy(renderer, texture, &risc_rect, &display_rect);
-  SDL_RenderPresent(renderer);
+  render_display(renderer, texture, &display_rect);
+
+  // Serial input can't wake us from SDL_WaitEventTimeout, and long
+  // waits would slow down virtual time.
+  bool can_sleep = !virtual_time && !serial_socket && !serial_in && !serial_out;
+  bool redraw = false;
 
   bool done = false;
   bool mouse_was_offscreen = false;
+  struct PS2Shift shift = { false, false };
   while (!done) {
-    uint32_t frame_start = SDL_GetTicks();
+    double now = host_ms();
+    int cycles = pacing_next_slice(pacing, now);
 
     SDL_Event event;
     while (SDL_PollEvent(&event)) {
+      pacing_input(pacing, now);
       switch (event.type) {
         case SDL_QUIT: {
           done = true;
@@ -264,12 +428,30 @@ int main (int argc, char *argv[]) {
         }
 
         case SDL_WINDOWEVENT: {
+          redraw = true;
           if (event.window.event == SDL_WINDOWEVENT_RESIZED) {
             display_scale = scale_display(window, &risc_rect, &display_rect);
+          } else if (event.window.event == SDL_WINDOWEVENT_FOCUS_GAINED) {
+            // Not every platform reports clipboard updates.
+            sdl_clipboard_changed();
+            // Shift may have been pressed while we weren't looking.
+            SDL_Keymod mod = SDL_GetModState();
+            shift.left = (mod & KMOD_LSHIFT) != 0;
+            shift.right = (mod & KMOD_RSHIFT) != 0;
           }
           break;
         }
 
+        case SDL_RENDER_TARGETS_RESET: {
+          redraw = true;
+          break;
+        }
+
+        case SDL_CLIPBOARDUPDATE: {
+          sdl_clipboard_changed();
+          break;
+        }
+
         case SDL_MOUSEMOTION: {
           int scaled_x = (int)round((event.motion.x - display_rect.x) / display_scale);
           int scaled_y = (int)round((event.motion.y - display_rect.y) / display_scale);
@@ -280,21 +462,30 @@ int main (int argc, char *argv[]) {
             SDL_ShowCursor(mouse_is_offscreen);
             mouse_was_offscreen = mouse_is_offscreen;
           }
-          risc_mouse_moved(risc, x, risc_rect.h - y - 1);
+          if (!player) {
+            risc_mouse_moved(risc, x, risc_rect.h - y - 1);
+          }
           break;
         }
 
         case SDL_MOUSEBUTTONDOWN:
         case SDL_MOUSEBUTTONUP: {
           bool down = event.button.state == SDL_PRESSED;
-          risc_mouse_button(risc, event.button.button, down);
+          if (!player) {
+            risc_mouse_button(risc, event.button.button, down);
+          }
           break;
         }
 
         case SDL_KEYDOWN:
         case SDL_KEYUP: {
           bool down = event.key.state == SDL_PRESSED;
-          switch (map_keyboard_event(&event.key)) {
+          enum Action action = map_keyboard_event(&event.key);
+          if (player && (action == ACTION_OBERON_INPUT || action >= ACTION_FAKE_MOUSE1)) {
+            // Don't mix live input into a replay.
+            break;
+          }
+          switch (action) {
             case ACTION_RESET: {
               risc_reset(risc);
               break;
@@ -326,7 +517,7 @@ int main (int argc, char *argv[]) {
             }
             case ACTION_OBERON_INPUT: {
               uint8_t ps2_bytes[MAX_PS2_CODE_LEN];
-              int len = ps2_encode(event.key.keysym.scancode, down, ps2_bytes);
+              int len = ps2_encode(&shift, event.key.keysym.scancode, down, ps2_bytes);
               risc_keyboard_input(risc, ps2_bytes, len);
               break;
             }
@@ -335,24 +526,79 @@ int main (int argc, char *argv[]) {
       }
     }
 
-    risc_set_time(risc, frame_start);
-    risc_run(risc, CPU_HZ / FPS);
-
-    update_texture(risc, texture, &risc_rect);
-    SDL_RenderClear(renderer);
-    SDL_RenderCopy(renderer, texture, &risc_rect, &display_rect);
-    SDL_RenderPresent(renderer);
+    risc_set_time(risc, SDL_GetTicks());
+    disk_set_time(disk, risc_get_time(risc));
+    if (host_fifo) {
+      host_fifo_flush(host_fifo);
+    }
+    if (typing_pos && *typing_pos) {
+      uint8_t ps2_bytes[4096];
+      uint32_t space = risc_keyboard_space(risc);
+      size_t len = ps2_encode_text(&typing_pos, ps2_bytes, space < sizeof(ps2_bytes) ? space : sizeof(ps2_bytes));
+      risc_keyboard_input(risc, ps2_bytes, (uint32_t)len);
+    }
+    if (player && !input_player_feed(player, risc)) {
+      input_player_free(player);
+      player = NULL;
+    }
+    int executed = risc_run(risc, cycles);
+    pacing_ran(pacing, host_ms(), cycles, executed);
+
+    now = host_ms();
+    if (pacing_present_due(pacing, now)) {
+      damage = risc_get_framebuffer_damage(risc);
+      bool changed = update_texture(risc, texture, &risc_rect, &damage);
+      if (fb_export) {
+        fb_export_frame(fb_export, risc, &damage);
+      }
+      if (screen_recorder) {
+        screen_recorder_frame(screen_recorder, risc, &damage);
+      }
+      if (changed || redraw) {
+        render_display(renderer, texture, &display_rect);
+        redraw = false;
+      }
+      pacing_presented(pacing, now, changed);
+    }
 
-    uint32_t frame_end = SDL_GetTicks();
-    int delay = frame_start + 1000/FPS - frame_end;
-    if (delay > 0) {
-      SDL_Delay(delay);
+    bool pending = player || (typing_pos && *typing_pos);
+    now = host_ms();
+    double wait = pacing_wait(pacing, now, can_sleep && !pending);
+    if (wait >= 1) {
+      if (pacing_guest_idle(pacing)) {
+        // Input ends the wait early.
+        SDL_WaitEventTimeout(NULL, (int)wait);
+      } else {
+        SDL_Delay((uint32_t)wait);
+      }
     }
   }
+
+  if (host_fifo) {
+    host_fifo_flush(host_fifo);
+  }
+  if (raw_serial) {
+    raw_serial_close(raw_serial);
+  }
+  if (ram_disk_save) {
+    disk_save(ram_disk_spi, ram_disk_save);
+  }
+  if (recorder) {
+    input_recorder_close(recorder, risc_get_cycles(risc));
+  }
+  if (player) {
+    input_player_free(player);
+  }
+  if (fb_export) {
+    fb_export_close(fb_export);
+  }
+  if (screen_recorder) {
+    screen_recorder_close(screen_recorder);
+  }
+  free(typing);
   return 0;
 }
 
-
 static int best_display(const SDL_Rect *rect) {
   int best = 0;
   int display_cnt = SDL_GetNumVideoDisplays();
@@ -369,6 +615,10 @@ static int best_display(const SDL_Rect *rect) {
   return best;
 }
 
+static double host_ms(void) {
+  return (double)SDL_GetPerformanceCounter() * 1000 / (double)SDL_GetPerformanceFrequency();
+}
+
 static int clamp(int x, int min, int max) {
   if (x < min) return min;
   if (x > max) return max;
@@ -422,19 +672,109 @@ static double scale_display(SDL_Window *window, const SDL_Rect *risc_rect, SDL_R
   return scale;
 }
 
+// The framebuffer is uploaded as the 8-bit luma plane of an IYUV
+// texture, a quarter of the ARGB data, and the renderer turns it into
+// colour: the display is filled with BLACK and the texture is added on
+// top, tinted with WHITE - BLACK. That only works if WHITE is at least
+// BLACK in every channel; other palettes use an ARGB texture.
+static bool luma_texture;
+
 // Only used in update_texture(), but some systems complain if you
-// allocate three megabyte on the stack.
+// allocate megabytes on the stack.
 static uint32_t pixel_buf[MAX_WIDTH * MAX_HEIGHT];
+static uint8_t luma_buf[MAX_WIDTH * MAX_HEIGHT];
+static uint8_t chroma_buf[MAX_WIDTH / 2 * ((MAX_HEIGHT + 1) / 2)];
+static uint8_t luma_table[256][8];
 
-static void update_texture(struct RISC *risc, SDL_Texture *texture, const SDL_Rect *risc_rect) {
-  struct Damage damage = risc_get_framebuffer_damage(risc);
-  if (damage.y1 <= damage.y2) {
+static uint8_t channel(uint32_t color, int shift) {
+  return (uint8_t)(color >> shift);
+}
+
+static SDL_Texture *create_texture(SDL_Renderer *renderer, const SDL_Rect *risc_rect) {
+  SDL_Texture *texture = NULL;
+  luma_texture = true;
+  for (int shift = 0; shift < 24; shift += 8) {
+    luma_texture &= channel(WHITE, shift) >= channel(BLACK, shift);
+  }
+  if (luma_texture) {
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_IYUV, SDL_TEXTUREACCESS_STREAMING,
+                                risc_rect->w, risc_rect->h);
+    if (texture == NULL ||
+        SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_ADD) != 0 ||
+        SDL_SetTextureColorMod(texture,
+                               channel(WHITE, 16) - channel(BLACK, 16),
+                               channel(WHITE, 8) - channel(BLACK, 8),
+                               channel(WHITE, 0) - channel(BLACK, 0)) != 0) {
+      if (texture) {
+        SDL_DestroyTexture(texture);
+      }
+      texture = NULL;
+      luma_texture = false;
+    }
+  }
+  if (luma_texture) {
+    // Video range luma, so 16 and 235 come out as exactly 0 and 1.
+    for (int i = 0; i < 256; i++) {
+      for (int b = 0; b < 8; b++) {
+        luma_table[i][b] = (i >> b) & 1 ? 235 : 16;
+      }
+    }
+    memset(chroma_buf, 128, sizeof(chroma_buf));
+  } else {
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                risc_rect->w, risc_rect->h);
+  }
+  if (texture == NULL) {
+    fail(1, "Could not create texture: %s", SDL_GetError());
+  }
+  return texture;
+}
+
+static void update_luma_texture(uint32_t *in, SDL_Texture *texture, const SDL_Rect *risc_rect,
+                                const struct Damage *damage) {
+  // Chroma is subsampled 2x2, so the rows are widened to even pairs.
+  int top = (risc_rect->h - damage->y2 - 1) & ~1;
+  int bottom = risc_rect->h - damage->y1;
+  if (bottom % 2 != 0 && bottom < risc_rect->h) {
+    bottom++;
+  }
+  SDL_Rect rect = {
+    .x = damage->x1 * 32,
+    .y = top,
+    .w = (damage->x2 - damage->x1 + 1) * 32,
+    .h = bottom - top
+  };
+
+  uint8_t *out = luma_buf;
+  for (int row = top; row < bottom; row++) {
+    int line_start = (risc_rect->h - row - 1) * (risc_rect->w / 32);
+    for (int col = damage->x1; col <= damage->x2; col++) {
+      uint32_t pixels = in[line_start + col];
+      for (int b = 0; b < 4; b++) {
+        memcpy(out, luma_table[pixels & 0xFF], 8);
+        pixels >>= 8;
+        out += 8;
+      }
+    }
+  }
+  SDL_UpdateYUVTexture(texture, &rect, luma_buf, rect.w,
+                       chroma_buf, rect.w / 2, chroma_buf, rect.w / 2);
+}
+
+// Returns whether anything changed.
+static bool update_texture(struct RISC *risc, SDL_Texture *texture, const SDL_Rect *risc_rect,
+                           const struct Damage *damage) {
+  if (damage->y1 <= damage->y2) {
     uint32_t *in = risc_get_framebuffer_ptr(risc);
-    uint32_t out_idx = 0;
+    if (luma_texture) {
+      update_luma_texture(in, texture, risc_rect, damage);
+      return true;
+    }
 
-    for (int line = damage.y2; line >= damage.y1; line--) {
+    uint32_t out_idx = 0;
+    for (int line = damage->y2; line >= damage->y1; line--) {
       int line_start = line * (risc_rect->w / 32);
-      for (int col = damage.x1; col <= damage.x2; col++) {
+      for (int col = damage->x1; col <= damage->x2; col++) {
         uint32_t pixels = in[line_start + col];
         for (int b = 0; b < 32; b++) {
           pixel_buf[out_idx] = (pixels & 1) ? WHITE : BLACK;
@@ -445,11 +785,49 @@ static void update_texture(struct RISC *risc, SDL_Texture *texture, const SDL_Re
     }
 
     SDL_Rect rect = {
-      .x = damage.x1 * 32,
-      .y = risc_rect->h - damage.y2 - 1,
-      .w = (damage.x2 - damage.x1 + 1) * 32,
-      .h = (damage.y2 - damage.y1 + 1)
+      .x = damage->x1 * 32,
+      .y = risc_rect->h - damage->y2 - 1,
+      .w = (damage->x2 - damage->x1 + 1) * 32,
+      .h = (damage->y2 - damage->y1 + 1)
     };
     SDL_UpdateTexture(texture, &rect, pixel_buf, rect.w * 4);
+    return true;
+  }
+  return false;
+}
+
+static void render_display(SDL_Renderer *renderer, SDL_Texture *texture, const SDL_Rect *display_rect) {
+  SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+  SDL_RenderClear(renderer);
+  if (luma_texture) {
+    SDL_SetRenderDrawColor(renderer, channel(BLACK, 16), channel(BLACK, 8), channel(BLACK, 0), 255);
+    SDL_RenderFillRect(renderer, display_rect);
+  }
+  SDL_RenderCopy(renderer, texture, NULL, display_rect);
+  SDL_RenderPresent(renderer);
+}
+
+static char *read_text_file(const char *filename) {
+  FILE *f = strcmp(filename, "-") == 0 ? stdin : fopen(filename, "rb");
+  if (!f) {
+    fail(1, "Can't open file \"%s\"", filename);
+  }
+  size_t len = 0, cap = 4096;
+  char *text = malloc(cap);
+  size_t n;
+  while (text && (n = fread(text + len, 1, cap - len - 1, f)) > 0) {
+    len += n;
+    if (cap - len - 1 == 0) {
+      cap *= 2;
+      text = realloc(text, cap);
+    }
+  }
+  if (!text) {
+    fail(1, "Out of memory");
+  }
+  text[len] = 0;
+  if (f != stdin) {
+    fclose(f);
   }
+  return text;
 }
@@ -1,6 +1,7 @@
 // Translate SDL scancodes to PS/2 codeset 2 scancodes.
 
-#include <SDL.h>
+#include <string.h>
+#include <SDL_scancode.h>
 #include "sdl-ps2.h"
 
 struct k_info {
@@ -16,11 +17,25 @@ enum k_type {
   K_SHIFT_HACK,
 };
 
+struct char_info {
+  unsigned char scancode;
+  unsigned char shift;
+};
+
 static struct k_info keymap[SDL_NUM_SCANCODES];
+static struct char_info charmap[128];
 
-int ps2_encode(int sdl_scancode, bool make, uint8_t out[static MAX_PS2_CODE_LEN]) {
+// The shift state is tracked from the codes we produce rather than
+// asked from SDL, so front ends without an SDL event loop can use the
+// tables too.
+int ps2_encode(struct PS2Shift *shift, int sdl_scancode, bool make, uint8_t out[static MAX_PS2_CODE_LEN]) {
   int i = 0;
   struct k_info info = keymap[sdl_scancode];
+  if (sdl_scancode == SDL_SCANCODE_LSHIFT) {
+    shift->left = make;
+  } else if (sdl_scancode == SDL_SCANCODE_RSHIFT) {
+    shift->right = make;
+  }
   switch (info.type) {
     case K_UNKNOWN: {
       break;
@@ -64,15 +79,14 @@ int ps2_encode(int sdl_scancode, bool make, uint8_t out[static MAX_PS2_CODE_LEN]
     }
 
     case K_SHIFT_HACK: {
-      SDL_Keymod mod = SDL_GetModState();
       if (make) {
         // fake shift release
-        if (mod & KMOD_LSHIFT) {
+        if (shift->left) {
           out[i++] = 0xE0;
           out[i++] = 0xF0;
           out[i++] = 0x12;
         }
-        if (mod & KMOD_RSHIFT) {
+        if (shift->right) {
           out[i++] = 0xE0;
           out[i++] = 0xF0;
           out[i++] = 0x59;
@@ -84,11 +98,11 @@ int ps2_encode(int sdl_scancode, bool make, uint8_t out[static MAX_PS2_CODE_LEN]
         out[i++] = 0xF0;
         out[i++] = info.code;
         // fake shift press
-        if (mod & KMOD_RSHIFT) {
+        if (shift->right) {
           out[i++] = 0xE0;
           out[i++] = 0x59;
         }
-        if (mod & KMOD_LSHIFT) {
+        if (shift->left) {
           out[i++] = 0xE0;
           out[i++] = 0x12;
         }
@@ -99,6 +113,83 @@ int ps2_encode(int sdl_scancode, bool make, uint8_t out[static MAX_PS2_CODE_LEN]
   return i;
 }
 
+int ps2_encode_char(struct PS2Shift *shift, int c, bool make, uint8_t out[static MAX_PS2_CODE_LEN]) {
+  if (c < 0 || c >= 128 || charmap[c].scancode == 0) {
+    return 0;
+  }
+  struct char_info info = charmap[c];
+  bool shifted = shift->left || shift->right;
+  int i = 0;
+  if (!make) {
+    i += ps2_encode(shift, info.scancode, false, &out[i]);
+  }
+  // Put the shift keys the way the character needs them while its key
+  // is down, and back the way they were afterwards.
+  if (info.shift && !shifted) {
+    out[i++] = make ? 0x12 : 0xF0;
+    if (!make) {
+      out[i++] = 0x12;
+    }
+  } else if (!info.shift && shifted) {
+    if (shift->left) {
+      if (make) {
+        out[i++] = 0xF0;
+      }
+      out[i++] = 0x12;
+    }
+    if (shift->right) {
+      if (make) {
+        out[i++] = 0xF0;
+      }
+      out[i++] = 0x59;
+    }
+  }
+  if (make) {
+    i += ps2_encode(shift, info.scancode, true, &out[i]);
+  }
+  return i;
+}
+
+size_t ps2_encode_text(const char **text, uint8_t *out, size_t out_len) {
+  const unsigned char *p = (const unsigned char *)*text;
+  size_t n = 0;
+  while (*p) {
+    if (*p >= 0x80) {
+      // Skip the whole UTF-8 sequence, there's no key for it.
+      do {
+        p++;
+      } while ((*p & 0xC0) == 0x80);
+      continue;
+    }
+    struct char_info c = charmap[*p];
+    if (c.scancode == 0 || (*p == '\r' && p[1] == '\n')) {
+      p++;
+      continue;
+    }
+    // The shift key is pressed and released around the character, so
+    // this doesn't touch the shift state of the real keyboard.
+    struct PS2Shift shift = { false, false };
+    uint8_t codes[4 * MAX_PS2_CODE_LEN];
+    int len = 0;
+    if (c.shift) {
+      len += ps2_encode(&shift, SDL_SCANCODE_LSHIFT, true, &codes[len]);
+    }
+    len += ps2_encode(&shift, c.scancode, true, &codes[len]);
+    len += ps2_encode(&shift, c.scancode, false, &codes[len]);
+    if (c.shift) {
+      len += ps2_encode(&shift, SDL_SCANCODE_LSHIFT, false, &codes[len]);
+    }
+    if ((size_t)len > out_len - n) {
+      break;
+    }
+    memcpy(&out[n], codes, (size_t)len);
+    n += (size_t)len;
+    p++;
+  }
+  *text = (const char *)p;
+  return n;
+}
+
 static struct k_info keymap[SDL_NUM_SCANCODES] = {
   [SDL_SCANCODE_A] = { 0x1C, K_NORMAL },
   [SDL_SCANCODE_B] = { 0x32, K_NORMAL },
@@ -213,3 +304,47 @@ static struct k_info keymap[SDL_NUM_SCANCODES] = {
   [SDL_SCANCODE_RALT]   = { 0x11, K_EXTENDED },
   [SDL_SCANCODE_RGUI]   = { 0x27, K_EXTENDED },
 };
+
+#define S(key) { SDL_SCANCODE_##key, 0 }
+#define SHIFT(key) { SDL_SCANCODE_##key, 1 }
+
+static struct char_info charmap[128] = {
+  ['\t'] = S(TAB), ['\n'] = S(RETURN), ['\r'] = S(RETURN), [' '] = S(SPACE),
+  ['\b'] = S(BACKSPACE), [0x1B] = S(ESCAPE),
+
+  ['a'] = S(A), ['b'] = S(B), ['c'] = S(C), ['d'] = S(D), ['e'] = S(E),
+  ['f'] = S(F), ['g'] = S(G), ['h'] = S(H), ['i'] = S(I), ['j'] = S(J),
+  ['k'] = S(K), ['l'] = S(L), ['m'] = S(M), ['n'] = S(N), ['o'] = S(O),
+  ['p'] = S(P), ['q'] = S(Q), ['r'] = S(R), ['s'] = S(S), ['t'] = S(T),
+  ['u'] = S(U), ['v'] = S(V), ['w'] = S(W), ['x'] = S(X), ['y'] = S(Y),
+  ['z'] = S(Z),
+
+  ['A'] = SHIFT(A), ['B'] = SHIFT(B), ['C'] = SHIFT(C), ['D'] = SHIFT(D),
+  ['E'] = SHIFT(E), ['F'] = SHIFT(F), ['G'] = SHIFT(G), ['H'] = SHIFT(H),
+  ['I'] = SHIFT(I), ['J'] = SHIFT(J), ['K'] = SHIFT(K), ['L'] = SHIFT(L),
+  ['M'] = SHIFT(M), ['N'] = SHIFT(N), ['O'] = SHIFT(O), ['P'] = SHIFT(P),
+  ['Q'] = SHIFT(Q), ['R'] = SHIFT(R), ['S'] = SHIFT(S), ['T'] = SHIFT(T),
+  ['U'] = SHIFT(U), ['V'] = SHIFT(V), ['W'] = SHIFT(W), ['X'] = SHIFT(X),
+  ['Y'] = SHIFT(Y), ['Z'] = SHIFT(Z),
+
+  ['1'] = S(1), ['2'] = S(2), ['3'] = S(3), ['4'] = S(4), ['5'] = S(5),
+  ['6'] = S(6), ['7'] = S(7), ['8'] = S(8), ['9'] = S(9), ['0'] = S(0),
+  ['!'] = SHIFT(1), ['@'] = SHIFT(2), ['#'] = SHIFT(3), ['$'] = SHIFT(4),
+  ['%'] = SHIFT(5), ['^'] = SHIFT(6), ['&'] = SHIFT(7), ['*'] = SHIFT(8),
+  ['('] = SHIFT(9), [')'] = SHIFT(0),
+
+  ['-'] = S(MINUS),        ['_'] = SHIFT(MINUS),
+  ['='] = S(EQUALS),       ['+'] = SHIFT(EQUALS),
+  ['['] = S(LEFTBRACKET),  ['{'] = SHIFT(LEFTBRACKET),
+  [']'] = S(RIGHTBRACKET), ['}'] = SHIFT(RIGHTBRACKET),
+  ['\\'] = S(BACKSLASH),   ['|'] = SHIFT(BACKSLASH),
+  [';'] = S(SEMICOLON),    [':'] = SHIFT(SEMICOLON),
+  ['\''] = S(APOSTROPHE),  ['"'] = SHIFT(APOSTROPHE),
+  ['`'] = S(GRAVE),        ['~'] = SHIFT(GRAVE),
+  [','] = S(COMMA),        ['<'] = SHIFT(COMMA),
+  ['.'] = S(PERIOD),       ['>'] = SHIFT(PERIOD),
+  ['/'] = S(SLASH),        ['?'] = SHIFT(SLASH),
+};
+
+#undef S
+#undef SHIFT
@@ -2,10 +2,29 @@
 #define SDL_PS2_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define MAX_PS2_CODE_LEN 8
 
-int ps2_encode(int sdl_scancode, bool make, uint8_t out[static MAX_PS2_CODE_LEN]);
+// Which shift keys are down, as far as the codes produced for one
+// keyboard go. Each source of key events keeps its own, starting out
+// zeroed.
+struct PS2Shift {
+  bool left, right;
+};
+
+int ps2_encode(struct PS2Shift *shift, int sdl_scancode, bool make, uint8_t out[static MAX_PS2_CODE_LEN]);
+
+// Encodes pressing or releasing the key that types ASCII character 'c'
+// on a US keyboard, with the shift keys pressed or released around it
+// as the character needs. Returns 0 if no key types it.
+int ps2_encode_char(struct PS2Shift *shift, int c, bool make, uint8_t out[static MAX_PS2_CODE_LEN]);
+
+// Translates UTF-8 text into the PS/2 codes for typing it on a US
+// keyboard, as far as it fits in 'out'. Advances '*text' past the
+// characters that were encoded and returns the number of bytes written.
+// Characters that have no key are skipped.
+size_t ps2_encode_text(const char **text, uint8_t *out, size_t out_len);
 
 #endif  // SDL_PS2_H
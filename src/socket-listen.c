@@ -0,0 +1,106 @@
+#ifdef _WIN32
+
+#include <stdio.h>
+#include "socket-listen.h"
+
+int socket_listen(const char *address) {
+  fprintf(stderr, "Listening sockets are not supported on Windows.\n");
+  return -1;
+}
+
+#else  // _WIN32
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "socket-listen.h"
+
+static int listen_unix(const char *path) {
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  struct stat st;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Socket path too long: %s\n", path);
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+  // Remove a socket left behind by an earlier run.
+  if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+    unlink(path);
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror("Failed to create socket");
+    return -1;
+  }
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 4) < 0) {
+    fprintf(stderr, "Failed to listen on %s: %s\n", path, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static int listen_tcp(const char *host, const char *port) {
+  struct addrinfo hints = {
+    .ai_family = AF_UNSPEC,
+    .ai_socktype = SOCK_STREAM,
+    .ai_flags = AI_PASSIVE
+  };
+  struct addrinfo *res, *ai;
+  int fd = -1;
+
+  int err = getaddrinfo(host, port, &hints, &res);
+  if (err != 0) {
+    fprintf(stderr, "Invalid address %s:%s: %s\n", host, port, gai_strerror(err));
+    return -1;
+  }
+  for (ai = res; ai; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 4) == 0) {
+      break;
+    }
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  if (fd < 0) {
+    fprintf(stderr, "Failed to listen on %s:%s\n", host, port);
+  }
+  return fd;
+}
+
+int socket_listen(const char *address) {
+  if (strncmp(address, "tcp:", 4) == 0) {
+    // tcp:PORT listens on localhost, tcp:HOST:PORT on the given address.
+    char host[256] = "localhost";
+    const char *port = address + 4;
+    const char *colon = strrchr(port, ':');
+    if (colon) {
+      size_t len = (size_t)(colon - port);
+      if (len >= sizeof(host)) {
+        fprintf(stderr, "Invalid address: %s\n", address);
+        return -1;
+      }
+      memcpy(host, port, len);
+      host[len] = 0;
+      port = colon + 1;
+    }
+    return listen_tcp(host, port);
+  }
+  return listen_unix(strncmp(address, "unix:", 5) == 0 ? address + 5 : address);
+}
+
+#endif  // _WIN32
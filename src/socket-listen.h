@@ -0,0 +1,9 @@
+#ifndef SOCKET_LISTEN_H
+#define SOCKET_LISTEN_H
+
+// Opens a listening socket. The address is a Unix socket path, which
+// may be prefixed with "unix:", or "tcp:PORT" to listen on localhost,
+// or "tcp:HOST:PORT". Prints what went wrong and returns -1 on failure.
+int socket_listen(const char *address);
+
+#endif  // SOCKET_LISTEN_H
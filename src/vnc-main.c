@@ -0,0 +1,256 @@
+#define _POSIX_C_SOURCE 200809L
+#include <getopt.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "risc.h"
+#include "risc-io.h"
+#include "disk.h"
+#include "pclink.h"
+#include "raw-serial.h"
+#include "host-fifo.h"
+#include "pacing.h"
+#include "fb-export.h"
+#include "screen-log.h"
+#include "vnc-server.h"
+
+// Runs the emulator in real time without a window, showing the screen
+// to VNC clients instead. Runs until interrupted.
+
+#define CPU_HZ 25000000
+#define FPS 60
+
+static struct option long_options[] = {
+  { "listen",           required_argument, NULL, 'L' },
+  { "mem",              required_argument, NULL, 'm' },
+  { "size",             required_argument, NULL, 's' },
+  { "serial-socket",    required_argument, NULL, 'U' },
+  { "ram-disk",         optional_argument, NULL, 'r' },
+  { "ram-disk-save",    required_argument, NULL, 'w' },
+  { "host-fifo",        required_argument, NULL, 'H' },
+  { "fps",              required_argument, NULL, 'F' },
+  { "speed",            required_argument, NULL, 'C' },
+  { "shm",              required_argument, NULL, 'M' },
+  { "record-screen",    required_argument, NULL, 'G' },
+  { NULL,               no_argument,       NULL, 0   }
+};
+
+static void usage() {
+  puts("Usage: risc-vnc [OPTIONS...] DISK-IMAGE\n"
+       "\n"
+       "Options:\n"
+       "  --listen ADDR         Accept VNC clients on ADDR (default tcp:5900)\n"
+       "  --mem MEGS            Set memory size\n"
+       "  --size WIDTHxHEIGHT   Set framebuffer size\n"
+       "  --serial-socket ADDR  Accept serial connections on a Unix socket\n"
+       "                        (or tcp:PORT, tcp:HOST:PORT)\n"
+       "  --ram-disk[=IMAGE]    Attach a RAM disk as second drive, optionally\n"
+       "                        seeded from IMAGE\n"
+       "  --ram-disk-save FILE  Save the RAM disk to FILE on exit\n"
+       "  --host-fifo FILE      Write the guest's host FIFO output to FILE\n"
+       "                        (- for stdout)\n"
+       "  --fps N               Target frame rate (default 60)\n"
+       "  --speed MHZ           Emulated clock rate (default 25)\n"
+       "  --shm NAME            Export the framebuffer in shared memory NAME\n"
+       "  --record-screen FILE  Record the screen to FILE (see tools/screenrec)\n"
+       );
+  exit(1);
+}
+
+static volatile sig_atomic_t done;
+
+static void stop(int sig) {
+  done = 1;
+}
+
+static double host_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1000 + (double)ts.tv_nsec / 1000000;
+}
+
+int main (int argc, char *argv[]) {
+  struct RISC *risc = risc_new();
+  risc_set_serial(risc, &pclink);
+
+  const char *listen_address = "tcp:5900";
+  int width = RISC_FRAMEBUFFER_WIDTH;
+  int height = RISC_FRAMEBUFFER_HEIGHT;
+  bool size_option = false;
+  int mem_option = 0;
+  const char *serial_socket = NULL;
+  struct RISC_Serial *raw_serial = NULL;
+  struct RISC_HostFIFO *host_fifo = NULL;
+  int fps = FPS;
+  uint32_t cycles_per_ms = CPU_HZ / 1000;
+  const char *shm_name = NULL;
+  const char *screen_file = NULL;
+  bool ram_disk = false;
+  const char *ram_disk_image = NULL;
+  const char *ram_disk_save = NULL;
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "L:m:s:U:r::w:H:F:C:M:G:", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'L': {
+        listen_address = optarg;
+        break;
+      }
+      case 'm': {
+        if (sscanf(optarg, "%d", &mem_option) != 1) {
+          usage();
+        }
+        break;
+      }
+      case 's': {
+        if (sscanf(optarg, "%dx%d", &width, &height) != 2 ||
+            width < 32 || width > 2048 || height < 32 || height > 2048) {
+          usage();
+        }
+        width &= ~31;
+        size_option = true;
+        break;
+      }
+      case 'U': {
+        serial_socket = optarg;
+        break;
+      }
+      case 'r': {
+        ram_disk = true;
+        ram_disk_image = optarg;
+        break;
+      }
+      case 'w': {
+        ram_disk = true;
+        ram_disk_save = optarg;
+        break;
+      }
+      case 'H': {
+        host_fifo = host_fifo_new(optarg);
+        risc_set_host_fifo(risc, host_fifo);
+        break;
+      }
+      case 'F': {
+        if (sscanf(optarg, "%d", &fps) != 1 || fps < 1 || fps > 1000) {
+          usage();
+        }
+        break;
+      }
+      case 'C': {
+        double mhz = strtod(optarg, 0);
+        if (!(mhz >= 1 && mhz <= 1000)) {
+          usage();
+        }
+        cycles_per_ms = (uint32_t)(mhz * 1000);
+        break;
+      }
+      case 'M': {
+        shm_name = optarg;
+        break;
+      }
+      case 'G': {
+        screen_file = optarg;
+        break;
+      }
+      default: {
+        usage();
+      }
+    }
+  }
+  if (optind != argc - 1) {
+    usage();
+  }
+
+  if (mem_option || size_option) {
+    risc_configure_memory(risc, mem_option, width, height);
+  }
+  struct RISC_SPI *disk = disk_new(argv[optind]);
+  risc_set_spi(risc, 1, disk);
+  struct RISC_SPI *ram_disk_spi = NULL;
+  if (ram_disk) {
+    ram_disk_spi = disk_new_ram(ram_disk_image);
+    risc_set_spi(risc, 2, ram_disk_spi);
+  }
+  if (serial_socket) {
+    raw_serial = raw_serial_listen(serial_socket);
+    risc_set_serial(risc, raw_serial);
+  }
+  struct VNCServer *vnc = vnc_server_new(listen_address, risc, width, height);
+  struct FBExport *fb_export = NULL;
+  if (shm_name) {
+    fb_export = fb_export_new(shm_name, width, height);
+  }
+  struct ScreenRecorder *screen_recorder = NULL;
+  if (screen_file) {
+    screen_recorder = screen_recorder_new(screen_file, width, height);
+  }
+  struct Pacing *pacing = pacing_new(cycles_per_ms, fps, 0);
+  // Serial clients would notice long waits.
+  bool can_sleep = !serial_socket;
+
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+  double start = host_ms();
+  while (!done) {
+    double now = host_ms();
+    int cycles = pacing_next_slice(pacing, now);
+    if (vnc_server_poll(vnc, 0)) {
+      pacing_input(pacing, now);
+    }
+
+    risc_set_time(risc, (uint32_t)(now - start));
+    disk_set_time(disk, risc_get_time(risc));
+    if (host_fifo) {
+      host_fifo_flush(host_fifo);
+    }
+    int executed = risc_run(risc, cycles);
+    pacing_ran(pacing, host_ms(), cycles, executed);
+
+    now = host_ms();
+    if (pacing_present_due(pacing, now)) {
+      struct Damage damage = risc_get_framebuffer_damage(risc);
+      vnc_server_update(vnc, &damage);
+      if (fb_export) {
+        fb_export_frame(fb_export, risc, &damage);
+      }
+      if (screen_recorder) {
+        screen_recorder_frame(screen_recorder, risc, &damage);
+      }
+      pacing_presented(pacing, now, damage.y1 <= damage.y2);
+    }
+
+    now = host_ms();
+    double end = now + pacing_wait(pacing, now, can_sleep);
+    // Clients are served while we wait. Their input ends the wait
+    // early if the guest is idle.
+    while (!done && end - now >= 1) {
+      if (vnc_server_poll(vnc, (int)(end - now))) {
+        pacing_input(pacing, host_ms());
+        if (pacing_guest_idle(pacing)) {
+          break;
+        }
+      }
+      now = host_ms();
+    }
+  }
+
+  if (host_fifo) {
+    host_fifo_flush(host_fifo);
+  }
+  if (raw_serial) {
+    raw_serial_close(raw_serial);
+  }
+  if (ram_disk_save) {
+    disk_save(ram_disk_spi, ram_disk_save);
+  }
+  if (fb_export) {
+    fb_export_close(fb_export);
+  }
+  if (screen_recorder) {
+    screen_recorder_close(screen_recorder);
+  }
+  return 0;
+}
@@ -0,0 +1,807 @@
+#ifdef _WIN32
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "vnc-server.h"
+
+struct VNCServer *vnc_server_new(const char *address, struct RISC *risc, int width, int height) {
+  fprintf(stderr, "The VNC server is not supported on Windows\n");
+  exit(1);
+}
+
+bool vnc_server_poll(struct VNCServer *vnc, int timeout_ms) {
+  return false;
+}
+
+void vnc_server_update(struct VNCServer *vnc, const struct Damage *damage) {
+}
+
+#else  // _WIN32
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <SDL_scancode.h>
+#include "vnc-server.h"
+#include "sdl-ps2.h"
+#include "socket-listen.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0  // we use SO_NOSIGPIPE instead
+#endif
+
+// Serves the framebuffer over the RFB protocol (RFC 6143), versions
+// 3.3 to 3.8 without authentication.
+//
+// Updates follow the damage reported by the emulator. Each client has
+// a copy of what it was last sent, which trims the damage down to the
+// words that really changed, in bands of 16 lines. The bands go out
+// Hextile encoded if the client allows it, since with two colors most
+// tiles come down to a background and a few foreground rectangles.
+// Otherwise they are sent raw.
+//
+// A client gets an update only when it has asked for one and has
+// received the previous one, so slow clients see fewer frames but
+// never hold up the emulator.
+
+#define MAX_CLIENTS 8
+#define IN_SIZE 4096
+#define BAND 16  // lines, the Hextile tile size
+
+enum { ENCODING_RAW = 0, ENCODING_HEXTILE = 5 };
+
+enum {
+  HEXTILE_RAW = 1,
+  HEXTILE_BACKGROUND = 2,
+  HEXTILE_FOREGROUND = 4,
+  HEXTILE_ANY_SUBRECTS = 8,
+};
+
+enum State {
+  STATE_VERSION,
+  STATE_SECURITY,
+  STATE_INIT,
+  STATE_NORMAL,
+};
+
+// In 32-pixel columns and lines counted from the top, inclusive. Empty
+// if y1 > y2.
+struct Area {
+  int x1, x2, y1, y2;
+};
+
+struct Client {
+  int fd;
+  enum State state;
+  int minor;  // protocol version 3.x
+  uint8_t in[IN_SIZE];
+  size_t in_len;
+  uint32_t skip;  // bytes of clipboard text still to be discarded
+  uint8_t *out;
+  size_t out_len, out_pos, out_cap;
+
+  int bytes_per_pixel;
+  bool big_endian;
+  uint32_t black, white;
+  bool hextile;
+
+  bool update_requested;
+  bool full_update;  // send all of dirty, even what the client has
+  struct Area dirty;
+  uint32_t *shadow;
+  int buttons;
+  struct PS2Shift shift;
+};
+
+struct VNCServer {
+  struct RISC *risc;
+  int width, height;
+  int words_per_line;
+  int listen_fd;
+  struct Client *clients[MAX_CLIENTS];
+  int num_clients;
+};
+
+static const struct Area empty_area = { 0, -1, 0, -1 };
+
+static int min(int a, int b) {
+  return a < b ? a : b;
+}
+
+static int max(int a, int b) {
+  return a > b ? a : b;
+}
+
+static void add_area(struct Area *a, const struct Area *b) {
+  if (b->y1 > b->y2) {
+    return;
+  }
+  if (a->y1 > a->y2) {
+    *a = *b;
+    return;
+  }
+  a->x1 = min(a->x1, b->x1);
+  a->x2 = max(a->x2, b->x2);
+  a->y1 = min(a->y1, b->y1);
+  a->y2 = max(a->y2, b->y2);
+}
+
+static uint32_t get_u16(const uint8_t *p) {
+  return (uint32_t)p[0] << 8 | p[1];
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+  return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static uint8_t *out_reserve(struct Client *c, size_t n) {
+  if (c->out_len + n > c->out_cap) {
+    c->out_cap = (c->out_len + n) * 2;
+    c->out = realloc(c->out, c->out_cap);
+    if (!c->out) {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+  }
+  uint8_t *p = &c->out[c->out_len];
+  c->out_len += n;
+  return p;
+}
+
+static void out_u8(struct Client *c, uint32_t v) {
+  *out_reserve(c, 1) = (uint8_t)v;
+}
+
+static void out_u16(struct Client *c, uint32_t v) {
+  uint8_t *p = out_reserve(c, 2);
+  p[0] = (uint8_t)(v >> 8);
+  p[1] = (uint8_t)v;
+}
+
+static void out_u32(struct Client *c, uint32_t v) {
+  uint8_t *p = out_reserve(c, 4);
+  p[0] = (uint8_t)(v >> 24);
+  p[1] = (uint8_t)(v >> 16);
+  p[2] = (uint8_t)(v >> 8);
+  p[3] = (uint8_t)v;
+}
+
+static void out_pixel(struct Client *c, bool white) {
+  uint32_t v = white ? c->white : c->black;
+  int n = c->bytes_per_pixel;
+  uint8_t *p = out_reserve(c, (size_t)n);
+  for (int i = 0; i < n; i++) {
+    int shift = c->big_endian ? (n - 1 - i) * 8 : i * 8;
+    p[i] = (uint8_t)(v >> shift);
+  }
+}
+
+static void set_nonblocking(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+static void drop_client(struct VNCServer *vnc, int i) {
+  struct Client *c = vnc->clients[i];
+  close(c->fd);
+  free(c->out);
+  free(c->shadow);
+  free(c);
+  vnc->clients[i] = vnc->clients[--vnc->num_clients];
+  fprintf(stderr, "VNC client disconnected.\n");
+}
+
+static bool flush_output(struct Client *c) {
+  while (c->out_pos < c->out_len) {
+    ssize_t n = send(c->fd, &c->out[c->out_pos], c->out_len - c->out_pos, MSG_NOSIGNAL);
+    if (n < 0) {
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    c->out_pos += (size_t)n;
+  }
+  c->out_len = c->out_pos = 0;
+  return true;
+}
+
+static void accept_client(struct VNCServer *vnc) {
+  int fd = accept(vnc->listen_fd, NULL, NULL);
+  if (fd < 0) {
+    return;
+  }
+  set_nonblocking(fd);
+  int one = 1;
+#ifdef SO_NOSIGPIPE
+  setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+  // Fails harmlessly on Unix sockets.
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  struct Client *c = calloc(1, sizeof(*c));
+  c->fd = fd;
+  c->state = STATE_VERSION;
+  c->bytes_per_pixel = 4;
+  c->white = 0xFFFFFF;
+  c->dirty = empty_area;
+  c->shadow = calloc((size_t)(vnc->words_per_line * vnc->height), sizeof(uint32_t));
+  memcpy(out_reserve(c, 12), "RFB 003.008\n", 12);
+  vnc->clients[vnc->num_clients++] = c;
+  fprintf(stderr, "VNC client connected.\n");
+  if (!flush_output(c)) {
+    drop_client(vnc, vnc->num_clients - 1);
+  }
+}
+
+// Finds foreground rectangles covering the set bits of a tile, one row
+// at a time, each extended down as far as it goes. Clears 'rows'.
+static int find_subrects(uint16_t rows[BAND], int w, int h, uint8_t subrects[]) {
+  int n = 0;
+  for (int y = 0; y < h; y++) {
+    while (rows[y]) {
+      int x1 = 0;
+      while (!(rows[y] >> x1 & 1)) {
+        x1++;
+      }
+      int x2 = x1;
+      while (x2 + 1 < w && (rows[y] >> (x2 + 1) & 1)) {
+        x2++;
+      }
+      uint16_t run = (uint16_t)(((1U << (x2 + 1)) - 1) & ~((1U << x1) - 1));
+      int y2 = y;
+      while (y2 + 1 < h && (rows[y2 + 1] & run) == run) {
+        y2++;
+      }
+      for (int i = y; i <= y2; i++) {
+        rows[i] &= (uint16_t)~run;
+      }
+      subrects[n * 2] = (uint8_t)(x1 << 4 | y);
+      subrects[n * 2 + 1] = (uint8_t)((x2 - x1) << 4 | (y2 - y));
+      n++;
+    }
+  }
+  return n;
+}
+
+// Reads the bits of a tile, at most 16 pixels wide and not crossing a
+// word, top row first.
+static int read_tile(struct VNCServer *vnc, int x, int y, int w, int h, uint16_t rows[BAND]) {
+  const uint32_t *fb = risc_get_framebuffer_ptr(vnc->risc);
+  uint32_t mask = (1U << w) - 1;
+  int ones = 0;
+  for (int i = 0; i < h; i++) {
+    int line = vnc->height - 1 - (y + i);
+    uint32_t word = fb[line * vnc->words_per_line + x / 32];
+    rows[i] = (uint16_t)((word >> (x % 32)) & mask);
+    for (uint32_t b = rows[i]; b; b &= b - 1) {
+      ones++;
+    }
+  }
+  return ones;
+}
+
+static void encode_raw_tile(struct Client *c, const uint16_t rows[BAND], int w, int h) {
+  for (int i = 0; i < h; i++) {
+    for (int j = 0; j < w; j++) {
+      out_pixel(c, rows[i] >> j & 1);
+    }
+  }
+}
+
+// Rectangles are in pixels here, x and w multiples of 32.
+static void encode_hextile(struct VNCServer *vnc, struct Client *c, int x, int y, int w, int h) {
+  bool have_bg = false, have_fg = false;
+  bool bg = false, fg = false;
+  for (int ty = y; ty < y + h; ty += BAND) {
+    int th = min(BAND, y + h - ty);
+    for (int tx = x; tx < x + w; tx += BAND) {
+      int tw = min(BAND, x + w - tx);
+      uint16_t rows[BAND];
+      int ones = read_tile(vnc, tx, ty, tw, th, rows);
+      int pixels = tw * th;
+
+      if (ones == 0 || ones == pixels) {
+        bool color = ones != 0;
+        if (have_bg && bg == color) {
+          out_u8(c, 0);
+        } else {
+          out_u8(c, HEXTILE_BACKGROUND);
+          out_pixel(c, color);
+          bg = color;
+          have_bg = true;
+        }
+        continue;
+      }
+
+      // The majority color is the background.
+      bool new_bg = ones * 2 > pixels;
+      uint16_t fg_rows[BAND];
+      for (int i = 0; i < th; i++) {
+        fg_rows[i] = new_bg ? (uint16_t)(~rows[i] & ((1U << tw) - 1)) : rows[i];
+      }
+      uint8_t subrects[BAND * BAND];
+      int n = find_subrects(fg_rows, tw, th, subrects);
+      int subencoding = HEXTILE_ANY_SUBRECTS;
+      int size = 2 + 2 * n;
+      if (!have_bg || bg != new_bg) {
+        subencoding |= HEXTILE_BACKGROUND;
+        size += c->bytes_per_pixel;
+      }
+      if (!have_fg || fg == new_bg) {
+        subencoding |= HEXTILE_FOREGROUND;
+        size += c->bytes_per_pixel;
+      }
+
+      if (size > 1 + pixels * c->bytes_per_pixel) {
+        // A raw tile leaves the colors undefined for the next one.
+        out_u8(c, HEXTILE_RAW);
+        encode_raw_tile(c, rows, tw, th);
+        have_bg = have_fg = false;
+        continue;
+      }
+      out_u8(c, (uint32_t)subencoding);
+      if (subencoding & HEXTILE_BACKGROUND) {
+        out_pixel(c, new_bg);
+      }
+      if (subencoding & HEXTILE_FOREGROUND) {
+        out_pixel(c, !new_bg);
+      }
+      out_u8(c, (uint32_t)n);
+      memcpy(out_reserve(c, (size_t)n * 2), subrects, (size_t)n * 2);
+      bg = new_bg;
+      fg = !new_bg;
+      have_bg = have_fg = true;
+    }
+  }
+}
+
+static void encode_raw(struct VNCServer *vnc, struct Client *c, int x, int y, int w, int h) {
+  const uint32_t *fb = risc_get_framebuffer_ptr(vnc->risc);
+  for (int i = y; i < y + h; i++) {
+    const uint32_t *row = &fb[(vnc->height - 1 - i) * vnc->words_per_line];
+    for (int j = x; j < x + w; j++) {
+      out_pixel(c, row[j / 32] >> (j % 32) & 1);
+    }
+  }
+}
+
+// Finds the part of one band that the client doesn't have yet.
+static struct Area changed_in_band(struct VNCServer *vnc, struct Client *c, int y1, int y2) {
+  const uint32_t *fb = risc_get_framebuffer_ptr(vnc->risc);
+  struct Area changed = empty_area;
+  for (int y = y1; y <= y2; y++) {
+    int start = (vnc->height - 1 - y) * vnc->words_per_line;
+    const uint32_t *row = &fb[start];
+    const uint32_t *shadow = &c->shadow[start];
+    int x1 = c->dirty.x1, x2 = c->dirty.x2;
+    if (!c->full_update) {
+      while (x1 <= x2 && row[x1] == shadow[x1]) {
+        x1++;
+      }
+      while (x2 >= x1 && row[x2] == shadow[x2]) {
+        x2--;
+      }
+    }
+    if (x1 <= x2) {
+      add_area(&changed, &(struct Area){ x1, x2, y, y });
+    }
+  }
+  return changed;
+}
+
+static void send_update(struct VNCServer *vnc, struct Client *c) {
+  if (!c->update_requested || c->out_len != 0 || c->dirty.y1 > c->dirty.y2) {
+    return;
+  }
+  struct Area rects[2048 / BAND];
+  int count = 0;
+  for (int band = c->dirty.y1 / BAND * BAND; band <= c->dirty.y2; band += BAND) {
+    struct Area a = changed_in_band(vnc, c, max(band, c->dirty.y1),
+                                    min(band + BAND - 1, c->dirty.y2));
+    if (a.y1 > a.y2) {
+      continue;
+    }
+    struct Area *prev = count ? &rects[count - 1] : NULL;
+    if (prev && prev->x1 == a.x1 && prev->x2 == a.x2 && prev->y2 == a.y1 - 1) {
+      prev->y2 = a.y2;
+    } else {
+      rects[count++] = a;
+    }
+  }
+  c->dirty = empty_area;
+  c->full_update = false;
+  if (count == 0) {
+    return;  // still requested
+  }
+
+  out_u8(c, 0);  // FramebufferUpdate
+  out_u8(c, 0);
+  out_u16(c, (uint32_t)count);
+  const uint32_t *fb = risc_get_framebuffer_ptr(vnc->risc);
+  for (int i = 0; i < count; i++) {
+    struct Area *a = &rects[i];
+    int x = a->x1 * 32, y = a->y1;
+    int w = (a->x2 - a->x1 + 1) * 32, h = a->y2 - a->y1 + 1;
+    out_u16(c, (uint32_t)x);
+    out_u16(c, (uint32_t)y);
+    out_u16(c, (uint32_t)w);
+    out_u16(c, (uint32_t)h);
+    out_u32(c, c->hextile ? ENCODING_HEXTILE : ENCODING_RAW);
+    if (c->hextile) {
+      encode_hextile(vnc, c, x, y, w, h);
+    } else {
+      encode_raw(vnc, c, x, y, w, h);
+    }
+    for (int line = vnc->height - 1 - a->y2; line <= vnc->height - 1 - a->y1; line++) {
+      int start = line * vnc->words_per_line + a->x1;
+      memcpy(&c->shadow[start], &fb[start], (size_t)(a->x2 - a->x1 + 1) * 4);
+    }
+  }
+  c->update_requested = false;
+}
+
+static void send_server_init(struct VNCServer *vnc, struct Client *c) {
+  static const char name[] = "Oberon";
+  out_u16(c, (uint32_t)vnc->width);
+  out_u16(c, (uint32_t)vnc->height);
+  // 32 bits per pixel, depth 24, little endian, true color
+  out_u8(c, 32);
+  out_u8(c, 24);
+  out_u8(c, 0);
+  out_u8(c, 1);
+  out_u16(c, 255);
+  out_u16(c, 255);
+  out_u16(c, 255);
+  out_u8(c, 16);
+  out_u8(c, 8);
+  out_u8(c, 0);
+  memset(out_reserve(c, 3), 0, 3);
+  out_u32(c, sizeof(name) - 1);
+  memcpy(out_reserve(c, sizeof(name) - 1), name, sizeof(name) - 1);
+}
+
+static bool set_pixel_format(struct Client *c, const uint8_t *m) {
+  int bits = m[4];
+  if (bits != 8 && bits != 16 && bits != 32) {
+    fprintf(stderr, "VNC client wants %d bits per pixel\n", bits);
+    return false;
+  }
+  c->bytes_per_pixel = bits / 8;
+  c->big_endian = m[6] != 0;
+  if (m[7]) {
+    c->black = 0;
+    c->white = get_u16(&m[8]) << (m[14] & 31) | get_u16(&m[10]) << (m[15] & 31) |
+               get_u16(&m[12]) << (m[16] & 31);
+  } else {
+    // Color map, we define entries 0 and 1.
+    c->black = 0;
+    c->white = 1;
+    out_u8(c, 1);  // SetColourMapEntries
+    out_u8(c, 0);
+    out_u16(c, 0);
+    out_u16(c, 2);
+    for (int i = 0; i < 3; i++) {
+      out_u16(c, 0);
+    }
+    for (int i = 0; i < 3; i++) {
+      out_u16(c, 0xFFFF);
+    }
+  }
+  return true;
+}
+
+static void update_request(struct VNCServer *vnc, struct Client *c, const uint8_t *m) {
+  c->update_requested = true;
+  if (m[1]) {
+    // Incremental. We send whatever changed, even outside the area
+    // asked for, which is the whole screen for all usual clients.
+    return;
+  }
+  int x = (int)get_u16(&m[2]), y = (int)get_u16(&m[4]);
+  int w = (int)get_u16(&m[6]), h = (int)get_u16(&m[8]);
+  struct Area a = {
+    .x1 = x / 32,
+    .x2 = (min(x + w, vnc->width) - 1) / 32,
+    .y1 = y,
+    .y2 = min(y + h, vnc->height) - 1,
+  };
+  if (w > 0 && a.x1 <= a.x2 && a.y1 <= a.y2) {
+    add_area(&c->dirty, &a);
+    c->full_update = true;
+  }
+}
+
+// X keysyms outside Latin-1 that have a key on the Oberon keyboard.
+static const struct {
+  uint32_t keysym;
+  int scancode;
+} keysyms[] = {
+  { 0xFF08, SDL_SCANCODE_BACKSPACE },
+  { 0xFF09, SDL_SCANCODE_TAB },
+  { 0xFF0D, SDL_SCANCODE_RETURN },
+  { 0xFF1B, SDL_SCANCODE_ESCAPE },
+  { 0xFF50, SDL_SCANCODE_HOME },
+  { 0xFF51, SDL_SCANCODE_LEFT },
+  { 0xFF52, SDL_SCANCODE_UP },
+  { 0xFF53, SDL_SCANCODE_RIGHT },
+  { 0xFF54, SDL_SCANCODE_DOWN },
+  { 0xFF55, SDL_SCANCODE_PAGEUP },
+  { 0xFF56, SDL_SCANCODE_PAGEDOWN },
+  { 0xFF57, SDL_SCANCODE_END },
+  { 0xFF63, SDL_SCANCODE_INSERT },
+  { 0xFF67, SDL_SCANCODE_APPLICATION },
+  { 0xFF8D, SDL_SCANCODE_KP_ENTER },
+  { 0xFFBE, SDL_SCANCODE_F1 },
+  { 0xFFBF, SDL_SCANCODE_F2 },
+  { 0xFFC0, SDL_SCANCODE_F3 },
+  { 0xFFC1, SDL_SCANCODE_F4 },
+  { 0xFFC2, SDL_SCANCODE_F5 },
+  { 0xFFC3, SDL_SCANCODE_F6 },
+  { 0xFFC4, SDL_SCANCODE_F7 },
+  { 0xFFC5, SDL_SCANCODE_F8 },
+  { 0xFFC6, SDL_SCANCODE_F9 },
+  { 0xFFC7, SDL_SCANCODE_F10 },
+  { 0xFFC8, SDL_SCANCODE_F11 },
+  { 0xFFC9, SDL_SCANCODE_F12 },
+  { 0xFFE1, SDL_SCANCODE_LSHIFT },
+  { 0xFFE2, SDL_SCANCODE_RSHIFT },
+  { 0xFFE3, SDL_SCANCODE_LCTRL },
+  { 0xFFE4, SDL_SCANCODE_RCTRL },
+  { 0xFFE9, SDL_SCANCODE_LALT },
+  { 0xFFEA, SDL_SCANCODE_RALT },
+  { 0xFFEB, SDL_SCANCODE_LGUI },
+  { 0xFFEC, SDL_SCANCODE_RGUI },
+  { 0xFFFF, SDL_SCANCODE_DELETE },
+};
+
+static void key_event(struct VNCServer *vnc, struct Client *c, uint32_t keysym, bool down) {
+  uint8_t ps2_bytes[MAX_PS2_CODE_LEN];
+  int len = 0;
+  if (keysym >= 0x20 && keysym < 0x7F) {
+    // Clients send the character, so the shift keys may need fixing.
+    len = ps2_encode_char(&c->shift, (int)keysym, down, ps2_bytes);
+  } else {
+    for (size_t i = 0; i < sizeof(keysyms) / sizeof(keysyms[0]); i++) {
+      if (keysyms[i].keysym == keysym) {
+        len = ps2_encode(&c->shift, keysyms[i].scancode, down, ps2_bytes);
+        break;
+      }
+    }
+  }
+  if (len) {
+    risc_keyboard_input(vnc->risc, ps2_bytes, (uint32_t)len);
+  }
+}
+
+static void pointer_event(struct VNCServer *vnc, struct Client *c, const uint8_t *m) {
+  int x = min((int)get_u16(&m[2]), vnc->width - 1);
+  int y = min((int)get_u16(&m[4]), vnc->height - 1);
+  risc_mouse_moved(vnc->risc, x, vnc->height - y - 1);
+  // Left, middle and right, like Oberon's buttons 1 to 3. The wheel
+  // bits are ignored.
+  for (int button = 1; button <= 3; button++) {
+    int bit = 1 << (button - 1);
+    if ((m[1] ^ c->buttons) & bit) {
+      risc_mouse_button(vnc->risc, button, m[1] & bit);
+    }
+  }
+  c->buttons = m[1] & 7;
+}
+
+// Returns how long the message at 'm' is, given the 'avail' bytes we
+// have of it, or 0 if we can't tell.
+static size_t message_length(const struct Client *c, const uint8_t *m, size_t avail) {
+  switch (c->state) {
+    case STATE_VERSION: return 12;
+    case STATE_SECURITY: return 1;
+    case STATE_INIT: return 1;
+    case STATE_NORMAL: break;
+  }
+  switch (m[0]) {
+    case 0: return 20;  // SetPixelFormat
+    case 2: return avail < 4 ? 4 : 4 + 4 * (size_t)get_u16(&m[2]);  // SetEncodings
+    case 3: return 10;  // FramebufferUpdateRequest
+    case 4: return 8;   // KeyEvent
+    case 5: return 6;   // PointerEvent
+    case 6: return 8;   // ClientCutText, the text is skipped
+    default: return 0;
+  }
+}
+
+// Handles one complete message. Returns false if the client must go.
+static bool handle_message(struct VNCServer *vnc, struct Client *c, const uint8_t *m, bool *input) {
+  switch (c->state) {
+    case STATE_VERSION: {
+      if (memcmp(m, "RFB 003.", 8) != 0) {
+        fprintf(stderr, "VNC client speaks an unknown protocol\n");
+        return false;
+      }
+      // Versions between those we know are handled as the older one.
+      int minor = (m[8] - '0') * 100 + (m[9] - '0') * 10 + (m[10] - '0');
+      c->minor = minor >= 8 ? 8 : minor == 7 ? 7 : 3;
+      if (c->minor == 3) {
+        out_u32(c, 1);  // security type None
+        c->state = STATE_INIT;
+      } else {
+        out_u8(c, 1);
+        out_u8(c, 1);
+        c->state = STATE_SECURITY;
+      }
+      return true;
+    }
+    case STATE_SECURITY: {
+      if (m[0] != 1) {
+        return false;
+      }
+      if (c->minor == 8) {
+        out_u32(c, 0);  // SecurityResult OK
+      }
+      c->state = STATE_INIT;
+      return true;
+    }
+    case STATE_INIT: {
+      // Everybody shares, whatever the client asked for.
+      send_server_init(vnc, c);
+      c->state = STATE_NORMAL;
+      return true;
+    }
+    case STATE_NORMAL: {
+      break;
+    }
+  }
+
+  switch (m[0]) {
+    case 0: {
+      return set_pixel_format(c, m);
+    }
+    case 2: {
+      c->hextile = false;
+      for (uint32_t i = 0; i < get_u16(&m[2]); i++) {
+        if (get_u32(&m[4 + i * 4]) == ENCODING_HEXTILE) {
+          c->hextile = true;
+        }
+      }
+      return true;
+    }
+    case 3: {
+      update_request(vnc, c, m);
+      return true;
+    }
+    case 4: {
+      key_event(vnc, c, get_u32(&m[4]), m[1] != 0);
+      *input = true;
+      return true;
+    }
+    case 5: {
+      pointer_event(vnc, c, m);
+      *input = true;
+      return true;
+    }
+    case 6: {
+      c->skip = get_u32(&m[4]);
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool read_input(struct VNCServer *vnc, struct Client *c, bool *input) {
+  ssize_t n = recv(c->fd, &c->in[c->in_len], IN_SIZE - c->in_len, 0);
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+    return false;
+  }
+  if (n > 0) {
+    c->in_len += (size_t)n;
+  }
+
+  size_t pos = 0;
+  while (pos < c->in_len) {
+    size_t avail = c->in_len - pos;
+    if (c->skip) {
+      uint32_t skip = avail < c->skip ? (uint32_t)avail : c->skip;
+      pos += skip;
+      c->skip -= skip;
+      continue;
+    }
+    size_t len = message_length(c, &c->in[pos], avail);
+    if (len == 0 || len > IN_SIZE) {
+      fprintf(stderr, "VNC client sent a message we can't handle\n");
+      return false;
+    }
+    if (len > avail) {
+      break;
+    }
+    if (!handle_message(vnc, c, &c->in[pos], input)) {
+      return false;
+    }
+    pos += len;
+  }
+  memmove(c->in, &c->in[pos], c->in_len - pos);
+  c->in_len -= pos;
+  return true;
+}
+
+struct VNCServer *vnc_server_new(const char *address, struct RISC *risc, int width, int height) {
+  int fd = socket_listen(address);
+  if (fd < 0) {
+    exit(1);
+  }
+  set_nonblocking(fd);
+
+  struct VNCServer *vnc = calloc(1, sizeof(*vnc));
+  vnc->risc = risc;
+  vnc->width = width;
+  vnc->height = height;
+  vnc->words_per_line = width / 32;
+  vnc->listen_fd = fd;
+  return vnc;
+}
+
+bool vnc_server_poll(struct VNCServer *vnc, int timeout_ms) {
+  struct pollfd fds[MAX_CLIENTS + 1];
+  int nfds = 0;
+  for (int i = 0; i < vnc->num_clients; i++) {
+    struct Client *c = vnc->clients[i];
+    fds[nfds++] = (struct pollfd){
+      .fd = c->fd,
+      .events = (short)(POLLIN | (c->out_len ? POLLOUT : 0))
+    };
+  }
+  if (vnc->num_clients < MAX_CLIENTS) {
+    fds[nfds++] = (struct pollfd){ .fd = vnc->listen_fd, .events = POLLIN };
+  }
+  if (poll(fds, (nfds_t)nfds, timeout_ms) <= 0) {
+    return false;
+  }
+
+  bool input = false;
+  // Backwards, dropping a client moves the last one into its place.
+  for (int i = vnc->num_clients - 1; i >= 0; i--) {
+    struct Client *c = vnc->clients[i];
+    bool ok = true;
+    if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+      ok = read_input(vnc, c, &input);
+    }
+    if (ok) {
+      ok = flush_output(c);
+    }
+    if (ok && c->out_len == 0) {
+      send_update(vnc, c);
+      ok = flush_output(c);
+    }
+    if (!ok) {
+      drop_client(vnc, i);
+    }
+  }
+  if (nfds > 0 && fds[nfds - 1].fd == vnc->listen_fd && fds[nfds - 1].revents) {
+    accept_client(vnc);
+  }
+  return input;
+}
+
+void vnc_server_update(struct VNCServer *vnc, const struct Damage *damage) {
+  if (damage->y1 > damage->y2) {
+    return;
+  }
+  struct Area a = {
+    .x1 = damage->x1,
+    .x2 = damage->x2,
+    .y1 = vnc->height - 1 - damage->y2,
+    .y2 = vnc->height - 1 - damage->y1,
+  };
+  for (int i = vnc->num_clients - 1; i >= 0; i--) {
+    struct Client *c = vnc->clients[i];
+    add_area(&c->dirty, &a);
+    send_update(vnc, c);
+    if (!flush_output(c)) {
+      drop_client(vnc, i);
+    }
+  }
+}
+
+#endif  // _WIN32
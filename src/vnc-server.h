@@ -0,0 +1,18 @@
+#ifndef VNC_SERVER_H
+#define VNC_SERVER_H
+
+#include <stdbool.h>
+#include "risc.h"
+
+struct VNCServer;
+
+struct VNCServer *vnc_server_new(const char *address, struct RISC *risc, int width, int height);
+
+// Serves the clients for up to timeout_ms milliseconds, returning early
+// if one of them sent keyboard or mouse input (then returns true).
+bool vnc_server_poll(struct VNCServer *vnc, int timeout_ms);
+
+// Called with what changed in the framebuffer since the last call.
+void vnc_server_update(struct VNCServer *vnc, const struct Damage *damage);
+
+#endif  // VNC_SERVER_H
@@ -0,0 +1,155 @@
+// Summarizes disk traces recorded with 'risc --disk-trace FILE':
+// per-sector heat map, sequential vs random access and host latency.
+
+use std::io::*;
+use std::fs::File;
+use std::env;
+use std::process::exit;
+use std::collections::HashMap;
+
+const MAGIC: &'static [u8] = b"ODSKTRC1";
+const RECORD_SIZE: usize = 24;
+const HEAT_COLUMNS: usize = 64;
+const HEAT_CHARS: &'static [u8] = b" .:-=+*#%@";
+
+struct Record {
+    cmd: u32,
+    sector: u32,
+    emu_time: u32,
+    latency: u32,
+}
+
+fn le32(b: &[u8]) -> u32 {
+    (b[0] as u32) | (b[1] as u32) << 8 | (b[2] as u32) << 16 | (b[3] as u32) << 24
+}
+
+fn read_trace(filename: &str) -> Result<Vec<Record>> {
+    let mut data = Vec::new();
+    File::open(filename)?.read_to_end(&mut data)?;
+    if data.len() < MAGIC.len() || &data[..MAGIC.len()] != MAGIC {
+        return Err(Error::new(ErrorKind::InvalidData, "not a disk trace"));
+    }
+    Ok(data[MAGIC.len()..].chunks(RECORD_SIZE)
+       .filter(|r| r.len() == RECORD_SIZE)
+       .map(|r| Record {
+           cmd: le32(&r[0..4]),
+           sector: le32(&r[4..8]),
+           emu_time: le32(&r[8..12]),
+           latency: le32(&r[12..16]),
+       })
+       .collect())
+}
+
+// Oberon reads and writes 1K sectors as two consecutive 512 byte
+// blocks, so we report sequentiality at both granularities.
+fn print_sequentiality(records: &[Record]) {
+    let mut block_seq = 0;
+    let mut sector_seq = 0;
+    let mut sector_cnt = 0;
+    let mut prev_block: Option<u32> = None;
+    let mut prev_sector: Option<u32> = None;
+    for r in records {
+        if prev_block == Some(r.sector.wrapping_sub(1)) {
+            block_seq += 1;
+        }
+        let sector = r.sector / 2;
+        if prev_sector != Some(sector) {
+            if prev_sector == Some(sector.wrapping_sub(1)) {
+                sector_seq += 1;
+            }
+            sector_cnt += 1;
+        }
+        prev_block = Some(r.sector);
+        prev_sector = Some(sector);
+    }
+    let pct = |n: usize, d: usize| if d == 0 { 0.0 } else { n as f64 * 100.0 / d as f64 };
+    println!("sequential blocks:  {:6.2}% ({} of {})",
+             pct(block_seq, records.len()), block_seq, records.len());
+    println!("sequential sectors: {:6.2}% ({} of {})",
+             pct(sector_seq, sector_cnt), sector_seq, sector_cnt);
+}
+
+fn print_hot_sectors(records: &[Record]) {
+    let mut counts: HashMap<u32, (u32, u32)> = HashMap::new();
+    for r in records {
+        let e = counts.entry(r.sector).or_insert((0, 0));
+        if r.cmd == 88 { e.1 += 1 } else { e.0 += 1 }
+    }
+    println!("distinct blocks: {}", counts.len());
+
+    let mut hot: Vec<_> = counts.iter().collect();
+    hot.sort_by(|a, b| ((b.1).0 + (b.1).1).cmp(&((a.1).0 + (a.1).1)).then(a.0.cmp(b.0)));
+    println!("hottest blocks:");
+    println!("  {:>10} {:>8} {:>8}", "block", "reads", "writes");
+    for &(sector, &(reads, writes)) in hot.iter().take(16) {
+        println!("  {:>10} {:>8} {:>8}", sector, reads, writes);
+    }
+
+    let lo = *counts.keys().min().unwrap();
+    let hi = *counts.keys().max().unwrap();
+    let width = ((hi - lo) as usize / HEAT_COLUMNS) + 1;
+    let mut heat = [0u32; HEAT_COLUMNS];
+    for r in records {
+        heat[(r.sector - lo) as usize / width] += 1;
+    }
+    let max = *heat.iter().max().unwrap() as f64;
+    let row: String = heat.iter().map(|&n| {
+        let level = if n == 0 { 0 } else {
+            1 + ((n as f64).ln() / max.ln().max(1.0) * (HEAT_CHARS.len() - 2) as f64) as usize
+        };
+        HEAT_CHARS[level.min(HEAT_CHARS.len() - 1)] as char
+    }).collect();
+    println!("heat map, blocks {}..{} ({} per column, log scale):", lo, hi, width);
+    println!("  [{}]", row);
+}
+
+fn print_latency(name: &str, records: &[Record], cmd: u32) {
+    let mut buckets = [0usize; 33];
+    let mut total = 0u64;
+    let mut cnt = 0;
+    for r in records.iter().filter(|r| r.cmd == cmd) {
+        buckets[(32 - r.latency.leading_zeros()) as usize] += 1;
+        total += r.latency as u64;
+        cnt += 1;
+    }
+    if cnt == 0 {
+        return;
+    }
+    println!("{} latency (host), mean {} ns:", name, total / cnt as u64);
+    let max = *buckets.iter().max().unwrap();
+    for (i, &n) in buckets.iter().enumerate().filter(|&(_, &n)| n > 0) {
+        let hi = if i == 0 { 0u64 } else { (1u64 << i) - 1 };
+        println!("  <= {:>10} ns {:>8} {}", hi, n, "#".repeat((n * 40 + max - 1) / max));
+    }
+}
+
+fn disktrace(filename: &str) -> Result<()> {
+    let records = read_trace(filename)?;
+    if records.is_empty() {
+        println!("empty trace");
+        return Ok(());
+    }
+    let reads = records.iter().filter(|r| r.cmd == 81).count();
+    let writes = records.iter().filter(|r| r.cmd == 88).count();
+    let first = records.first().unwrap().emu_time;
+    let last = records.last().unwrap().emu_time;
+    println!("commands: {} ({} reads, {} writes) over {} ms emulated time",
+             records.len(), reads, writes, last.wrapping_sub(first));
+    print_sequentiality(&records);
+    print_hot_sectors(&records);
+    print_latency("read", &records, 81);
+    print_latency("write", &records, 88);
+    Ok(())
+}
+
+fn main() {
+    let args: Vec<String> = env::args().collect();
+    if args.len() != 2 {
+        writeln!(&mut stderr(), "Usage: disktrace TRACE-FILE").unwrap();
+        exit(1);
+    }
+    if let Err(e) = disktrace(&args[1]) {
+        writeln!(&mut stderr(), "disktrace: {}", e).unwrap();
+        exit(1);
+    }
+}
@@ -0,0 +1,657 @@
+// Lists, extracts, inserts and deletes files in an Oberon disk image,
+// without booting the emulator.
+//
+// Handles both full SD card images (file system at block 0x80000) and
+// file system only images, which start directly at sector 1.
+
+use std::io::*;
+use std::fs::{self, File, OpenOptions};
+use std::env;
+use std::path::Path;
+use std::process::exit;
+use std::time::UNIX_EPOCH;
+
+pub mod filedir {
+    use std::io::*;
+    use std::fs::File;
+    use std::collections::{HashMap, HashSet};
+
+    pub const SECTOR_SIZE: usize = 1024;
+    pub const HEADER_SIZE: usize = 352;
+    pub const FN_LENGTH: usize = 32;
+    pub const SEC_TAB_SIZE: usize = 64;
+    pub const EX_TAB_SIZE: usize = 12;
+    pub const INDEX_SIZE: usize = SECTOR_SIZE / 4;
+    pub const DIR_PG_SIZE: usize = 24;
+    pub const N: usize = DIR_PG_SIZE / 2;
+    pub const DIR_ROOT_ADR: u32 = 29;
+    pub const DIR_MARK: u32 = 0x9B1EA38D;
+    pub const HEADER_MARK: u32 = 0x9BA71D86;
+    pub const MAX_SECTORS: u32 = 0x10000;  // size of the kernel's sector map
+    pub const RESERVED_SECTORS: u32 = 64;  // never allocated by the kernel
+    pub const MAX_FILE_SECTORS: usize = SEC_TAB_SIZE + EX_TAB_SIZE * INDEX_SIZE;
+
+    // Byte offset of the file system in a full SD card image.
+    const FS_OFFSET: u64 = 0x80000 * 512;
+
+    type Sector = [u8; SECTOR_SIZE];
+
+    fn get32(s: &[u8], off: usize) -> u32 {
+        (s[off] as u32) | (s[off+1] as u32) << 8 | (s[off+2] as u32) << 16 | (s[off+3] as u32) << 24
+    }
+
+    fn put32(s: &mut [u8], off: usize, v: u32) {
+        for i in 0..4 {
+            s[off+i] = (v >> (i * 8)) as u8;
+        }
+    }
+
+    fn invalid(msg: String) -> Error {
+        Error::new(ErrorKind::InvalidData, msg)
+    }
+
+    #[derive(Clone)]
+    pub struct DirEntry {
+        pub name: Vec<u8>,
+        pub adr: u32,
+        pub p: u32,
+    }
+
+    #[derive(Clone)]
+    struct DirPage {
+        p0: u32,
+        e: Vec<DirEntry>,
+    }
+
+    pub struct FileInfo {
+        pub name: String,
+        pub adr: u32,
+        pub length: usize,
+        pub date: u32,
+    }
+
+    pub struct Volume {
+        file: File,
+        // Byte offset of sector 0 (DiskAdr 0), may be "negative".
+        base: i64,
+        used: HashSet<u32>,
+        next_free: u32,
+    }
+
+    impl Volume {
+        pub fn open(file: File) -> Result<Volume> {
+            let mut vol = Volume { file: file, base: 0, used: HashSet::new(), next_free: RESERVED_SECTORS };
+            for &base in &[-(SECTOR_SIZE as i64), FS_OFFSET as i64] {
+                vol.base = base;
+                if get32(&vol.get_sector(DIR_ROOT_ADR)?, 0) == DIR_MARK {
+                    vol.mark_sectors()?;
+                    return Ok(vol);
+                }
+            }
+            Err(invalid("no Oberon file system found".to_string()))
+        }
+
+        fn offset(&self, adr: u32) -> Result<u64> {
+            if adr == 0 || adr % 29 != 0 || adr / 29 >= MAX_SECTORS {
+                return Err(invalid(format!("bad disk address {}", adr)));
+            }
+            Ok((self.base + (adr / 29) as i64 * SECTOR_SIZE as i64) as u64)
+        }
+
+        fn get_sector(&mut self, adr: u32) -> Result<Sector> {
+            let mut s = [0u8; SECTOR_SIZE];
+            let off = self.offset(adr)?;
+            self.file.seek(SeekFrom::Start(off))?;
+            let mut filled = 0;
+            while filled < SECTOR_SIZE {
+                let n = self.file.read(&mut s[filled..])?;
+                if n == 0 {
+                    break;  // past the end of the image: zeros
+                }
+                filled += n;
+            }
+            Ok(s)
+        }
+
+        fn put_sector(&mut self, adr: u32, s: &Sector) -> Result<()> {
+            let off = self.offset(adr)?;
+            self.file.seek(SeekFrom::Start(off))?;
+            self.file.write_all(s)
+        }
+
+        // Like Kernel.AllocSector. Sectors that are no longer referenced
+        // are implicitly free, the kernel rebuilds its map at boot.
+        fn alloc_sector(&mut self) -> Result<u32> {
+            while self.next_free < MAX_SECTORS {
+                let sec = self.next_free;
+                self.next_free += 1;
+                if !self.used.contains(&sec) {
+                    self.used.insert(sec);
+                    return Ok(sec * 29);
+                }
+            }
+            Err(Error::new(ErrorKind::Other, "disk full"))
+        }
+
+        fn mark(&mut self, adr: u32) -> Result<()> {
+            self.offset(adr)?;
+            self.used.insert(adr / 29);
+            Ok(())
+        }
+
+        // Like FileDir.Init: mark directory pages and all file sectors.
+        fn mark_sectors(&mut self) -> Result<()> {
+            for sec in 0..RESERVED_SECTORS {
+                self.used.insert(sec);
+            }
+            let mut pages = vec![DIR_ROOT_ADR];
+            while let Some(adr) = pages.pop() {
+                self.mark(adr)?;
+                let page = self.get_page(adr)?;
+                if page.p0 != 0 {
+                    pages.push(page.p0);
+                }
+                for e in &page.e {
+                    if e.p != 0 {
+                        pages.push(e.p);
+                    }
+                    for sec in self.file_sectors(e.adr, true)? {
+                        self.mark(sec)?;
+                    }
+                }
+            }
+            Ok(())
+        }
+
+        fn get_page(&mut self, adr: u32) -> Result<DirPage> {
+            let s = self.get_sector(adr)?;
+            if get32(&s, 0) != DIR_MARK {
+                return Err(invalid(format!("bad directory page at {}", adr)));
+            }
+            let m = get32(&s, 4) as usize;
+            if m > DIR_PG_SIZE {
+                return Err(invalid(format!("bad directory page at {}", adr)));
+            }
+            let e = (0..m).map(|i| {
+                let off = 64 + i * 40;
+                let name = &s[off..off+FN_LENGTH];
+                let len = name.iter().position(|&c| c == 0).unwrap_or(FN_LENGTH);
+                DirEntry { name: name[..len].to_vec(), adr: get32(&s, off+32), p: get32(&s, off+36) }
+            }).collect();
+            Ok(DirPage { p0: get32(&s, 8), e: e })
+        }
+
+        fn put_page(&mut self, adr: u32, page: &DirPage) -> Result<()> {
+            let mut s = [0u8; SECTOR_SIZE];
+            put32(&mut s, 0, DIR_MARK);
+            put32(&mut s, 4, page.e.len() as u32);
+            put32(&mut s, 8, page.p0);
+            for (i, e) in page.e.iter().enumerate() {
+                let off = 64 + i * 40;
+                s[off..off+e.name.len()].copy_from_slice(&e.name);
+                put32(&mut s, off+32, e.adr);
+                put32(&mut s, off+36, e.p);
+            }
+            self.put_sector(adr, &s)
+        }
+
+        // All sectors of a file: header, data and extension index sectors.
+        fn file_sectors(&mut self, hdr_adr: u32, with_index: bool) -> Result<Vec<u32>> {
+            let hdr = self.get_sector(hdr_adr)?;
+            if get32(&hdr, 0) != HEADER_MARK {
+                return Err(invalid(format!("bad file header at {}", hdr_adr)));
+            }
+            let count = get32(&hdr, 36) as usize + 1;
+            if count > MAX_FILE_SECTORS {
+                return Err(invalid(format!("bad file length at {}", hdr_adr)));
+            }
+            let mut secs = Vec::new();
+            for i in 0..count.min(SEC_TAB_SIZE) {
+                secs.push(get32(&hdr, 96 + i * 4));
+            }
+            let mut i = SEC_TAB_SIZE;
+            let mut x = 0;
+            while i < count {
+                let ext_adr = get32(&hdr, 48 + x * 4);
+                if with_index {
+                    secs.push(ext_adr);
+                }
+                let index = self.get_sector(ext_adr)?;
+                for k in 0..(count - i).min(INDEX_SIZE) {
+                    secs.push(get32(&index, k * 4));
+                }
+                i += INDEX_SIZE;
+                x += 1;
+            }
+            Ok(secs)
+        }
+
+        pub fn list(&mut self) -> Result<Vec<FileInfo>> {
+            let mut files = Vec::new();
+            self.enumerate(DIR_ROOT_ADR, &mut files)?;
+            Ok(files)
+        }
+
+        fn enumerate(&mut self, adr: u32, files: &mut Vec<FileInfo>) -> Result<()> {
+            let page = self.get_page(adr)?;
+            if page.p0 != 0 {
+                self.enumerate(page.p0, files)?;
+            }
+            for e in &page.e {
+                let hdr = self.get_sector(e.adr)?;
+                let aleng = get32(&hdr, 36) as usize;
+                let bleng = get32(&hdr, 40) as usize;
+                files.push(FileInfo {
+                    name: String::from_utf8_lossy(&e.name).into_owned(),
+                    adr: e.adr,
+                    length: (aleng * SECTOR_SIZE + bleng).saturating_sub(HEADER_SIZE),
+                    date: get32(&hdr, 44),
+                });
+                if e.p != 0 {
+                    self.enumerate(e.p, files)?;
+                }
+            }
+            Ok(())
+        }
+
+        pub fn search(&mut self, name: &[u8]) -> Result<Option<u32>> {
+            let mut adr = DIR_ROOT_ADR;
+            loop {
+                let page = self.get_page(adr)?;
+                let r = page.e.iter().position(|e| name <= &e.name[..]).unwrap_or(page.e.len());
+                if r < page.e.len() && name == &page.e[r].name[..] {
+                    return Ok(Some(page.e[r].adr));
+                }
+                adr = if r == 0 { page.p0 } else { page.e[r-1].p };
+                if adr == 0 {
+                    return Ok(None);
+                }
+            }
+        }
+
+        pub fn read_file(&mut self, name: &[u8]) -> Result<Vec<u8>> {
+            let adr = match self.search(name)? {
+                Some(adr) => adr,
+                None => return Err(Error::new(ErrorKind::NotFound, "file not found")),
+            };
+            let hdr = self.get_sector(adr)?;
+            let aleng = get32(&hdr, 36) as usize;
+            let bleng = get32(&hdr, 40) as usize;
+            let total = aleng * SECTOR_SIZE + bleng;
+            let mut data = Vec::with_capacity(total);
+            for sec in self.file_sectors(adr, false)? {
+                data.extend_from_slice(&self.get_sector(sec)?);
+            }
+            data.truncate(total);
+            Ok(data.split_off(HEADER_SIZE.min(data.len())))
+        }
+
+        pub fn write_file(&mut self, name: &[u8], contents: &[u8], date: u32) -> Result<()> {
+            check_name(name)?;
+            let total = contents.len() + HEADER_SIZE;
+            // Like Files.WriteByte: bleng is 1..SectorSize, never 0.
+            let aleng = (total - 1) / SECTOR_SIZE;
+            let bleng = total - aleng * SECTOR_SIZE;
+            if aleng + 1 > MAX_FILE_SECTORS {
+                return Err(Error::new(ErrorKind::Other, "file too large"));
+            }
+
+            let mut data = vec![0u8; HEADER_SIZE];
+            data.extend_from_slice(contents);
+            let mut secs = Vec::new();
+            for _ in 0..aleng+1 {
+                secs.push(self.alloc_sector()?);
+            }
+            let ext_cnt = (aleng + 1).saturating_sub(SEC_TAB_SIZE);
+            let ext_cnt = (ext_cnt + INDEX_SIZE - 1) / INDEX_SIZE;
+            let mut exts = Vec::new();
+            for _ in 0..ext_cnt {
+                exts.push(self.alloc_sector()?);
+            }
+
+            for (i, chunk) in data.chunks(SECTOR_SIZE).enumerate().skip(1) {
+                let mut s = [0u8; SECTOR_SIZE];
+                s[..chunk.len()].copy_from_slice(chunk);
+                self.put_sector(secs[i], &s)?;
+            }
+            for (x, &ext) in exts.iter().enumerate() {
+                let mut s = [0u8; SECTOR_SIZE];
+                let first = SEC_TAB_SIZE + x * INDEX_SIZE;
+                for (k, &sec) in secs[first..].iter().take(INDEX_SIZE).enumerate() {
+                    put32(&mut s, k * 4, sec);
+                }
+                self.put_sector(ext, &s)?;
+            }
+
+            let mut hdr = [0u8; SECTOR_SIZE];
+            put32(&mut hdr, 0, HEADER_MARK);
+            hdr[4..4+name.len()].copy_from_slice(name);
+            put32(&mut hdr, 36, aleng as u32);
+            put32(&mut hdr, 40, bleng as u32);
+            put32(&mut hdr, 44, date);
+            for (x, &ext) in exts.iter().enumerate() {
+                put32(&mut hdr, 48 + x * 4, ext);
+            }
+            for (i, &sec) in secs.iter().take(SEC_TAB_SIZE).enumerate() {
+                put32(&mut hdr, 96 + i * 4, sec);
+            }
+            let first = data.len().min(SECTOR_SIZE);
+            hdr[HEADER_SIZE..first].copy_from_slice(&data[HEADER_SIZE..first]);
+            self.put_sector(secs[0], &hdr)?;
+
+            self.insert(name, secs[0])
+        }
+
+        // FileDir.Insert: the root page always stays at DirRootAdr.
+        fn insert(&mut self, name: &[u8], fad: u32) -> Result<()> {
+            let mut pages = HashMap::new();
+            if let Some(u) = self.insert_page(name, DIR_ROOT_ADR, fad, &mut pages)? {
+                let old_root = self.alloc_sector()?;
+                let root = pages.remove(&DIR_ROOT_ADR).unwrap();
+                pages.insert(old_root, root);
+                pages.insert(DIR_ROOT_ADR, DirPage { p0: old_root, e: vec![u] });
+            }
+            for (adr, page) in pages {
+                self.put_page(adr, &page)?;
+            }
+            Ok(())
+        }
+
+        // Returns the entry to be inserted in the parent if the page was split.
+        fn insert_page(&mut self, name: &[u8], adr: u32, fad: u32,
+                       pages: &mut HashMap<u32, DirPage>) -> Result<Option<DirEntry>> {
+            let mut a = self.get_page(adr)?;
+            let r = a.e.iter().position(|e| name <= &e.name[..]).unwrap_or(a.e.len());
+            if r < a.e.len() && name == &a.e[r].name[..] {
+                a.e[r].adr = fad;  // replace
+                pages.insert(adr, a);
+                return Ok(None);
+            }
+            let child = if r == 0 { a.p0 } else { a.e[r-1].p };
+            let u = if child == 0 {
+                DirEntry { name: name.to_vec(), adr: fad, p: 0 }
+            } else {
+                match self.insert_page(name, child, fad, pages)? {
+                    Some(u) => u,
+                    None => return Ok(None),
+                }
+            };
+            a.e.insert(r, u);
+            if a.e.len() <= DIR_PG_SIZE {
+                pages.insert(adr, a);
+                return Ok(None);
+            }
+            // Split: keep N entries here, move the middle one up and the
+            // remaining N to a new page.
+            let right_adr = self.alloc_sector()?;
+            let right_e = a.e.split_off(N + 1);
+            let mut v = a.e.pop().unwrap();
+            pages.insert(right_adr, DirPage { p0: v.p, e: right_e });
+            pages.insert(adr, a);
+            v.p = right_adr;
+            Ok(Some(v))
+        }
+
+        // FileDir.Delete, returns false if the file doesn't exist.
+        pub fn delete(&mut self, name: &[u8]) -> Result<bool> {
+            let mut pages = HashMap::new();
+            let (found, _) = self.delete_page(name, DIR_ROOT_ADR, &mut pages)?;
+            if found {
+                let root = pages.get(&DIR_ROOT_ADR).cloned();
+                if let Some(root) = root {
+                    if root.e.is_empty() && root.p0 != 0 {
+                        // Root underflow: pull the only child up into the root.
+                        let child = match pages.remove(&root.p0) {
+                            Some(child) => child,
+                            None => self.get_page(root.p0)?,
+                        };
+                        pages.insert(DIR_ROOT_ADR, child);
+                    }
+                }
+                for (adr, page) in pages {
+                    self.put_page(adr, &page)?;
+                }
+            }
+            Ok(found)
+        }
+
+        fn page(&mut self, adr: u32, pages: &HashMap<u32, DirPage>) -> Result<DirPage> {
+            match pages.get(&adr) {
+                Some(page) => Ok(page.clone()),
+                None => self.get_page(adr),
+            }
+        }
+
+        // Returns (found, underflow).
+        fn delete_page(&mut self, name: &[u8], adr: u32,
+                       pages: &mut HashMap<u32, DirPage>) -> Result<(bool, bool)> {
+            let mut a = self.page(adr, pages)?;
+            let r = a.e.iter().position(|e| name <= &e.name[..]).unwrap_or(a.e.len());
+            let child = if r == 0 { a.p0 } else { a.e[r-1].p };
+            if r < a.e.len() && name == &a.e[r].name[..] {
+                if child == 0 {
+                    a.e.remove(r);
+                    let h = a.e.len() < N;
+                    pages.insert(adr, a);
+                    return Ok((true, h));
+                }
+                // Replace by the largest entry of the left subtree.
+                let (last, h) = self.delete_last(child, pages)?;
+                a.e[r].name = last.name;
+                a.e[r].adr = last.adr;
+                pages.insert(adr, a);
+                let h = h && self.underflow(adr, r, pages)?;
+                return Ok((true, h));
+            }
+            if child == 0 {
+                return Ok((false, false));
+            }
+            let (found, h) = self.delete_page(name, child, pages)?;
+            let h = h && self.underflow(adr, r, pages)?;
+            Ok((found, h))
+        }
+
+        fn delete_last(&mut self, adr: u32,
+                       pages: &mut HashMap<u32, DirPage>) -> Result<(DirEntry, bool)> {
+            let mut a = self.page(adr, pages)?;
+            let m = a.e.len();
+            let child = a.e[m-1].p;
+            if child == 0 {
+                let last = a.e.pop().unwrap();
+                let h = a.e.len() < N;
+                pages.insert(adr, a);
+                return Ok((last, h));
+            }
+            let (last, h) = self.delete_last(child, pages)?;
+            let h = h && self.underflow(adr, m, pages)?;
+            Ok((last, h))
+        }
+
+        // Child k of page adr (p0 is child 0, e[i].p is child i+1) has
+        // fewer than N entries: borrow from a sibling or merge with it.
+        // Returns true if page adr itself underflows.
+        fn underflow(&mut self, adr: u32, k: usize,
+                     pages: &mut HashMap<u32, DirPage>) -> Result<bool> {
+            let mut a = self.page(adr, pages)?;
+            let child_adr = |a: &DirPage, k: usize| if k == 0 { a.p0 } else { a.e[k-1].p };
+            let (left_k, right_k) = if k < a.e.len() { (k, k + 1) } else { (k - 1, k) };
+            let left_adr = child_adr(&a, left_k);
+            let right_adr = child_adr(&a, right_k);
+            let mut left = self.page(left_adr, pages)?;
+            let mut right = self.page(right_adr, pages)?;
+            let mut sep = a.e[left_k].clone();
+
+            if left.e.len() + right.e.len() < DIR_PG_SIZE {
+                // Merge right and the separator into left.
+                sep.p = right.p0;
+                left.e.push(sep);
+                left.e.extend(right.e.drain(..));
+                a.e.remove(left_k);
+                pages.remove(&right_adr);
+                pages.insert(left_adr, left);
+            } else if left.e.len() < right.e.len() {
+                // Rotate one entry from right to left.
+                let mut first = right.e.remove(0);
+                sep.p = right.p0;
+                right.p0 = first.p;
+                left.e.push(sep);
+                first.p = right_adr;
+                a.e[left_k] = first;
+                pages.insert(left_adr, left);
+                pages.insert(right_adr, right);
+            } else {
+                // Rotate one entry from left to right.
+                let mut last = left.e.pop().unwrap();
+                sep.p = right.p0;
+                right.p0 = last.p;
+                right.e.insert(0, sep);
+                last.p = right_adr;
+                a.e[left_k] = last;
+                pages.insert(left_adr, left);
+                pages.insert(right_adr, right);
+            }
+            let h = a.e.len() < N;
+            pages.insert(adr, a);
+            Ok(h)
+        }
+
+        // Verifies the B-tree ordering and page occupancy invariants.
+        pub fn check(&mut self) -> Result<usize> {
+            let mut prev = None;
+            let (count, _) = self.check_page(DIR_ROOT_ADR, true, &mut prev)?;
+            Ok(count)
+        }
+
+        fn check_page(&mut self, adr: u32, root: bool, prev: &mut Option<Vec<u8>>) -> Result<(usize, usize)> {
+            let page = self.get_page(adr)?;
+            if !root && page.e.len() < N {
+                return Err(invalid(format!("directory page {} underflows", adr)));
+            }
+            let mut count = 0;
+            let mut depth = None;
+            let mut children = vec![page.p0];
+            children.extend(page.e.iter().map(|e| e.p));
+            for (i, &child) in children.iter().enumerate() {
+                let d = if child == 0 { 0 } else {
+                    let (c, d) = self.check_page(child, false, prev)?;
+                    count += c;
+                    d + 1
+                };
+                if depth.is_some() && depth != Some(d) {
+                    return Err(invalid(format!("directory page {} is unbalanced", adr)));
+                }
+                depth = Some(d);
+                if i < page.e.len() {
+                    let name = page.e[i].name.clone();
+                    if prev.as_ref().map_or(false, |p| *p >= name) {
+                        return Err(invalid(format!("directory page {} is out of order", adr)));
+                    }
+                    self.file_sectors(page.e[i].adr, true)?;
+                    *prev = Some(name);
+                    count += 1;
+                }
+            }
+            Ok((count, depth.unwrap()))
+        }
+    }
+
+    // FileDir's naming rules: a letter followed by letters, digits or dots.
+    pub fn check_name(name: &[u8]) -> Result<()> {
+        let ok = !name.is_empty() && name.len() < FN_LENGTH
+            && name[0].is_ascii_alphabetic()
+            && name.iter().all(|&c| c.is_ascii_alphanumeric() || c == b'.');
+        if ok { Ok(()) } else {
+            Err(Error::new(ErrorKind::InvalidInput,
+                           format!("bad file name '{}'", String::from_utf8_lossy(name))))
+        }
+    }
+
+    // Oberon clock format, as used by Kernel.Clock.
+    pub fn oberon_date(year: u32, month: u32, day: u32, hour: u32, min: u32, sec: u32) -> u32 {
+        ((((year % 100 * 16 + month) * 32 + day) * 32 + hour) * 64 + min) * 64 + sec
+    }
+}
+
+fn civil_from_unix(t: u64) -> (u32, u32, u32, u32, u32, u32) {
+    let days = (t / 86400) as i64;
+    let secs = (t % 86400) as u32;
+    // Howard Hinnant's days_from_civil, inverted.
+    let z = days + 719468;
+    let era = z.div_euclid(146097);
+    let doe = z - era * 146097;
+    let yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    let doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    let mp = (5 * doy + 2) / 153;
+    let day = (doy - (153 * mp + 2) / 5 + 1) as u32;
+    let month = if mp < 10 { mp + 3 } else { mp - 9 } as u32;
+    let year = (yoe + era * 400 + if month <= 2 { 1 } else { 0 }) as u32;
+    (year, month, day, secs / 3600, secs / 60 % 60, secs % 60)
+}
+
+fn format_date(d: u32) -> String {
+    format!("{:02}.{:02}.{:02} {:02}:{:02}:{:02}",
+            d >> 17 & 31, d >> 22 & 15, d >> 26 & 63, d >> 12 & 31, d >> 6 & 63, d & 63)
+}
+
+fn usage() -> ! {
+    writeln!(&mut stderr(), "Usage: oberonfs IMAGE ls\n       \
+                             oberonfs IMAGE get NAME...\n       \
+                             oberonfs IMAGE put FILE...\n       \
+                             oberonfs IMAGE rm NAME...\n       \
+                             oberonfs IMAGE check").unwrap();
+    exit(1);
+}
+
+fn oberonfs(args: &[String]) -> Result<()> {
+    if args.len() < 2 {
+        usage();
+    }
+    let writable = args[1] == "put" || args[1] == "rm";
+    let file = OpenOptions::new().read(true).write(writable).open(&args[0])?;
+    let mut vol = filedir::Volume::open(file)?;
+    match &args[1][..] {
+        "ls" => {
+            for f in vol.list()? {
+                println!("{:<32} {:>8}  {}", f.name, f.length, format_date(f.date));
+            }
+        }
+        "get" => {
+            for name in &args[2..] {
+                let data = vol.read_file(name.as_bytes())
+                    .map_err(|e| Error::new(e.kind(), format!("{}: {}", name, e)))?;
+                File::create(name)?.write_all(&data)?;
+            }
+        }
+        "put" => {
+            for path in &args[2..] {
+                let data = fs::read(path)?;
+                let name = Path::new(path).file_name().unwrap().to_string_lossy().into_owned();
+                let mtime = fs::metadata(path)?.modified()?
+                    .duration_since(UNIX_EPOCH).map(|d| d.as_secs()).unwrap_or(0);
+                let (y, mo, d, h, mi, s) = civil_from_unix(mtime);
+                vol.write_file(name.as_bytes(), &data, filedir::oberon_date(y, mo, d, h, mi, s))
+                    .map_err(|e| Error::new(e.kind(), format!("{}: {}", path, e)))?;
+            }
+        }
+        "rm" => {
+            for name in &args[2..] {
+                if !vol.delete(name.as_bytes())? {
+                    writeln!(&mut stderr(), "oberonfs: {}: file not found", name)?;
+                }
+            }
+        }
+        "check" => {
+            println!("{} files, directory ok", vol.check()?);
+        }
+        _ => usage(),
+    }
+    Ok(())
+}
+
+fn main() {
+    let args: Vec<String> = env::args().skip(1).collect();
+    if let Err(e) = oberonfs(&args) {
+        writeln!(&mut stderr(), "oberonfs: {}", e).unwrap();
+        exit(1);
+    }
+}
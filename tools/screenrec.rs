@@ -0,0 +1,397 @@
+// Converts screen recordings made with 'risc --record-screen FILE' to
+// animated GIFs or raw video, or summarizes them. The file format is
+// described in src/screen-log.c.
+
+use std::io::*;
+use std::fs::File;
+use std::env;
+use std::process::exit;
+
+const MAGIC: &'static [u8] = b"OSCREEN1";
+const BLACK: [u8; 3] = [0x00, 0x00, 0x00];
+const WHITE: [u8; 3] = [0xFF, 0xFF, 0xFF];
+
+fn invalid(msg: &str) -> Error {
+    Error::new(ErrorKind::InvalidData, msg)
+}
+
+struct Recording {
+    data: Vec<u8>,
+    pos: usize,
+    width: usize,
+    height: usize,
+    time: u64,          // of the last frame applied, ms
+    next: Option<u64>,  // time of the frame peeked at
+    ended: bool,
+    screen: Vec<u32>,   // as the guest has it, lines bottom up
+}
+
+impl Recording {
+    fn open(filename: &str) -> Result<Recording> {
+        let mut data = Vec::new();
+        File::open(filename)?.read_to_end(&mut data)?;
+        if data.len() < MAGIC.len() || &data[..MAGIC.len()] != MAGIC {
+            return Err(invalid("not a screen recording"));
+        }
+        let mut rec = Recording {
+            data: data, pos: MAGIC.len(), width: 0, height: 0,
+            time: 0, next: None, ended: false, screen: Vec::new(),
+        };
+        rec.width = rec.number()? as usize;
+        rec.height = rec.number()? as usize;
+        if rec.width == 0 || rec.width % 32 != 0 || rec.height == 0 {
+            return Err(invalid("bad screen size"));
+        }
+        rec.screen = vec![0; rec.width / 32 * rec.height];
+        Ok(rec)
+    }
+
+    fn byte(&mut self) -> Result<u8> {
+        if self.pos >= self.data.len() {
+            return Err(invalid("recording is truncated"));
+        }
+        self.pos += 1;
+        Ok(self.data[self.pos - 1])
+    }
+
+    fn number(&mut self) -> Result<u64> {
+        let mut n = 0u64;
+        let mut shift = 0;
+        loop {
+            let b = self.byte()?;
+            n |= ((b & 0x7F) as u64) << shift;
+            if b < 0x80 {
+                return Ok(n);
+            }
+            shift += 7;
+            if shift > 63 {
+                return Err(invalid("bad number"));
+            }
+        }
+    }
+
+    fn word(&mut self) -> Result<u32> {
+        let mut w = 0u32;
+        for i in 0..4 {
+            w |= (self.byte()? as u32) << (i * 8);
+        }
+        Ok(w)
+    }
+
+    // Returns the time of the next frame without applying it, or None
+    // at the end. A recording that was cut off (the emulator crashed)
+    // ends at its last complete frame.
+    fn peek(&mut self) -> Result<Option<u64>> {
+        if self.next.is_some() || self.ended {
+            return Ok(self.next);
+        }
+        if self.pos == self.data.len() {
+            writeln!(&mut stderr(), "screenrec: recording has no end marker").unwrap();
+            self.ended = true;
+            return Ok(None);
+        }
+        match self.byte()? {
+            b'F' => {
+                self.next = Some(self.time + self.number()?);
+            }
+            b'E' => {
+                self.time += self.number()?;
+                self.ended = true;
+            }
+            _ => return Err(invalid("bad frame")),
+        }
+        Ok(self.next)
+    }
+
+    // Applies the frame that peek returned to the screen.
+    fn apply(&mut self) -> Result<()> {
+        let mut pos = 0usize;
+        loop {
+            let skip = self.number()? as usize;
+            let n = self.number()? as usize;
+            if n == 0 {
+                break;
+            }
+            let (count, fill) = (n / 2, n % 2 == 1);
+            pos += skip;
+            if pos + count > self.screen.len() {
+                return Err(invalid("frame data outside the screen"));
+            }
+            if fill {
+                let w = self.word()?;
+                for i in pos..pos + count {
+                    self.screen[i] = w;
+                }
+            } else {
+                for i in pos..pos + count {
+                    self.screen[i] = self.word()?;
+                }
+            }
+            pos += count;
+        }
+        self.time = self.next.take().unwrap();
+        Ok(())
+    }
+
+    fn pixel(&self, x: usize, y: usize) -> u8 {
+        let line = self.height - 1 - y;
+        ((self.screen[line * (self.width / 32) + x / 32] >> (x % 32)) & 1) as u8
+    }
+}
+
+// Calls 'f' with the screen as it was at each tick of a clock running
+// at 'fps' from the first frame to the end of the recording.
+fn sample<F>(rec: &mut Recording, fps: u32, mut f: F) -> Result<()>
+    where F: FnMut(&Recording, u64) -> Result<()>
+{
+    let start = match rec.peek()? {
+        Some(t) => t,
+        None => return Ok(()),
+    };
+    let mut tick = 0u64;
+    loop {
+        let t = start + tick * 1000 / fps as u64;
+        while let Some(frame_time) = rec.peek()? {
+            if frame_time > t {
+                break;
+            }
+            rec.apply()?;
+        }
+        f(rec, t - start)?;
+        if rec.ended && t >= rec.time {
+            return Ok(());
+        }
+        tick += 1;
+    }
+}
+
+struct BitWriter {
+    bytes: Vec<u8>,
+    acc: u32,
+    bits: u32,
+}
+
+impl BitWriter {
+    fn put(&mut self, code: u32, size: u32) {
+        self.acc |= code << self.bits;
+        self.bits += size;
+        while self.bits >= 8 {
+            self.bytes.push(self.acc as u8);
+            self.acc >>= 8;
+            self.bits -= 8;
+        }
+    }
+
+    fn finish(mut self) -> Vec<u8> {
+        if self.bits > 0 {
+            self.bytes.push(self.acc as u8);
+        }
+        self.bytes
+    }
+}
+
+// GIF flavored LZW, for pixels that are 0 or 1.
+fn lzw(pixels: &[u8]) -> Vec<u8> {
+    const MIN_SIZE: u32 = 2;
+    const CLEAR: u32 = 1 << MIN_SIZE;
+    const END: u32 = CLEAR + 1;
+    let mut out = BitWriter { bytes: Vec::new(), acc: 0, bits: 0 };
+    let mut table = vec![[0u16; 2]; 4096];
+    let mut next = END + 1;
+    let mut size = MIN_SIZE + 1;
+    out.put(CLEAR, size);
+    let mut prefix = pixels[0] as u32;
+    for &p in &pixels[1..] {
+        let code = table[prefix as usize][p as usize];
+        if code != 0 {
+            prefix = code as u32;
+            continue;
+        }
+        out.put(prefix, size);
+        if next < 4096 {
+            table[prefix as usize][p as usize] = next as u16;
+            next += 1;
+            if next > (1 << size) && size < 12 {
+                size += 1;
+            }
+        } else {
+            out.put(CLEAR, size);
+            for e in table.iter_mut() {
+                *e = [0, 0];
+            }
+            next = END + 1;
+            size = MIN_SIZE + 1;
+        }
+        prefix = p as u32;
+    }
+    out.put(prefix, size);
+    out.put(END, size);
+    out.finish()
+}
+
+fn le16(out: &mut Vec<u8>, n: usize) {
+    out.push(n as u8);
+    out.push((n >> 8) as u8);
+}
+
+struct GifFrame {
+    x: usize,
+    y: usize,
+    w: usize,
+    h: usize,
+    pixels: Vec<u8>,
+    time: u64,
+}
+
+fn write_gif_frame(out: &mut Vec<u8>, f: &GifFrame, delay_cs: u64) {
+    // Graphic control: keep the previous frame, this one only covers
+    // what changed.
+    out.extend_from_slice(&[0x21, 0xF9, 4, 1 << 2]);
+    le16(out, delay_cs.min(0xFFFF) as usize);
+    out.extend_from_slice(&[0, 0]);
+    out.push(0x2C);
+    le16(out, f.x);
+    le16(out, f.y);
+    le16(out, f.w);
+    le16(out, f.h);
+    out.push(0);
+    out.push(2);  // LZW minimum code size
+    for block in lzw(&f.pixels).chunks(255) {
+        out.push(block.len() as u8);
+        out.extend_from_slice(block);
+    }
+    out.push(0);
+}
+
+fn gif(filename: &str, output: &str, fps: u32) -> Result<()> {
+    let mut rec = Recording::open(filename)?;
+    let (width, height) = (rec.width, rec.height);
+    let mut out = Vec::new();
+    out.extend_from_slice(b"GIF89a");
+    le16(&mut out, width);
+    le16(&mut out, height);
+    out.extend_from_slice(&[0x80, 0, 0]);  // two color global table
+    out.extend_from_slice(&BLACK);
+    out.extend_from_slice(&WHITE);
+
+    let mut shown: Option<Vec<u32>> = None;
+    let mut pending: Option<GifFrame> = None;
+    let mut frames = 0;
+    sample(&mut rec, fps, |rec, time| {
+        // Find the columns and lines that changed, top down.
+        let wpl = width / 32;
+        let (mut x1, mut x2, mut y1, mut y2) = (wpl, 0, height, 0);
+        for y in 0..height {
+            let line = height - 1 - y;
+            for x in 0..wpl {
+                let i = line * wpl + x;
+                if shown.as_ref().map_or(true, |s| s[i] != rec.screen[i]) {
+                    x1 = x1.min(x);
+                    x2 = x2.max(x);
+                    y1 = y1.min(y);
+                    y2 = y2.max(y);
+                }
+            }
+        }
+        if x1 > x2 {
+            return Ok(());
+        }
+        let (x, y, w, h) = (x1 * 32, y1, (x2 - x1 + 1) * 32, y2 - y1 + 1);
+        let mut pixels = Vec::with_capacity(w * h);
+        for j in y..y + h {
+            for i in x..x + w {
+                pixels.push(rec.pixel(i, j));
+            }
+        }
+        if let Some(p) = pending.take() {
+            // Rounded per frame would drift.
+            let delay = (time + 5) / 10 - (p.time + 5) / 10;
+            write_gif_frame(&mut out, &p, delay);
+        }
+        pending = Some(GifFrame { x: x, y: y, w: w, h: h, pixels: pixels, time: time });
+        shown = Some(rec.screen.clone());
+        frames += 1;
+        Ok(())
+    })?;
+    if let Some(p) = pending.take() {
+        write_gif_frame(&mut out, &p, 100);
+    }
+    out.push(0x3B);
+    File::create(output)?.write_all(&out)?;
+    println!("{} frames", frames);
+    Ok(())
+}
+
+fn raw(filename: &str, fps: u32) -> Result<()> {
+    let mut rec = Recording::open(filename)?;
+    let stdout = stdout();
+    let mut out = BufWriter::new(stdout.lock());
+    let mut frame = vec![0u8; rec.width * rec.height];
+    writeln!(&mut stderr(), "{}x{} at {} fps, 8 bit gray", rec.width, rec.height, fps).unwrap();
+    sample(&mut rec, fps, |rec, _| {
+        for y in 0..rec.height {
+            for x in 0..rec.width {
+                frame[y * rec.width + x] = if rec.pixel(x, y) != 0 { 0xFF } else { 0 };
+            }
+        }
+        out.write_all(&frame)
+    })?;
+    out.flush()
+}
+
+fn info(filename: &str) -> Result<()> {
+    let mut rec = Recording::open(filename)?;
+    let mut frames = 0u64;
+    let mut largest = 0usize;
+    let start = rec.peek()?.unwrap_or(0);
+    let mut pos = rec.pos;
+    while let Some(_) = rec.peek()? {
+        rec.apply()?;
+        frames += 1;
+        largest = largest.max(rec.pos - pos);
+        pos = rec.pos;
+    }
+    println!("screen:   {}x{}", rec.width, rec.height);
+    println!("frames:   {}", frames);
+    println!("duration: {} ms", rec.time - start);
+    println!("size:     {} bytes, {} per frame on average, largest {}",
+             rec.data.len(), rec.data.len() as u64 / frames.max(1), largest);
+    Ok(())
+}
+
+fn usage() -> ! {
+    writeln!(&mut stderr(), "Usage: screenrec info RECORDING\n       \
+                             screenrec gif RECORDING OUTPUT.gif [FPS]\n       \
+                             screenrec raw RECORDING [FPS] > OUTPUT\n\
+                             \n\
+                             GIFs default to 25 fps, raw video (8 bit gray, for ffmpeg's\n\
+                             -f rawvideo -pix_fmt gray) to 30.").unwrap();
+    exit(1);
+}
+
+fn fps_arg(args: &[String], i: usize, default: u32) -> u32 {
+    match args.get(i) {
+        None => default,
+        Some(s) => match s.parse() {
+            Ok(n) if n >= 1 && n <= 1000 => n,
+            _ => usage(),
+        },
+    }
+}
+
+fn main() {
+    let args: Vec<String> = env::args().collect();
+    if args.len() < 3 {
+        usage();
+    }
+    let result = match (args[1].as_str(), args.len()) {
+        ("info", 3) => info(&args[2]),
+        ("gif", 4) | ("gif", 5) => gif(&args[2], &args[3], fps_arg(&args, 4, 25)),
+        ("raw", 3) | ("raw", 4) => raw(&args[2], fps_arg(&args, 3, 30)),
+        _ => usage(),
+    };
+    if let Err(e) = result {
+        writeln!(&mut stderr(), "screenrec: {}", e).unwrap();
+        exit(1);
+    }
+}
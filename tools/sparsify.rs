@@ -0,0 +1,79 @@
+// Rewrites a disk image so that blocks which contain only zeros become
+// holes in the host file. The emulator avoids storing zero sectors as
+// it runs, but images that were copied around or written by older
+// versions are usually fully allocated.
+
+use std::io::*;
+use std::fs;
+use std::fs::File;
+use std::env;
+use std::process::exit;
+
+// Most host filesystems allocate in 4K blocks; smaller holes don't
+// save any space.
+const BLOCK_SIZE: usize = 4096;
+
+fn allocated(meta: &fs::Metadata) -> Option<u64> {
+    #[cfg(unix)]
+    {
+        use std::os::unix::fs::MetadataExt;
+        return Some(meta.blocks() * 512);
+    }
+    #[cfg(not(unix))]
+    {
+        let _ = meta;
+        return None;
+    }
+}
+
+fn sparsify(input: &str, output: &str) -> Result<()> {
+    let tmpname = format!("{}.sparsify-tmp", output);
+    let before = allocated(&fs::metadata(input)?);
+    {
+        let mut src = BufReader::new(File::open(input)?);
+        let mut dst = File::create(&tmpname)?;
+        let mut buf = [0u8; BLOCK_SIZE];
+        let mut size = 0u64;
+        loop {
+            let mut n = 0;
+            while n < BLOCK_SIZE {
+                match src.read(&mut buf[n..])? {
+                    0 => break,
+                    k => n += k,
+                }
+            }
+            if n == 0 {
+                break;
+            }
+            if buf[..n].iter().all(|&b| b == 0) {
+                dst.seek(SeekFrom::Current(n as i64))?;
+            } else {
+                dst.write_all(&buf[..n])?;
+            }
+            size += n as u64;
+        }
+        // A trailing run of zeros would otherwise be lost.
+        dst.set_len(size)?;
+        dst.sync_all()?;
+    }
+    fs::set_permissions(&tmpname, fs::metadata(input)?.permissions())?;
+    fs::rename(&tmpname, output)?;
+
+    if let (Some(b), Some(a)) = (before, allocated(&fs::metadata(output)?)) {
+        println!("{}: {} KiB allocated, was {} KiB", output, a / 1024, b / 1024);
+    }
+    Ok(())
+}
+
+fn main() {
+    let args: Vec<String> = env::args().collect();
+    if args.len() != 2 && args.len() != 3 {
+        writeln!(&mut stderr(), "Usage: sparsify IMAGE [OUTPUT]").unwrap();
+        exit(1);
+    }
+    let output = if args.len() == 3 { &args[2] } else { &args[1] };
+    if let Err(e) = sparsify(&args[1], output) {
+        writeln!(&mut stderr(), "sparsify: {}", e).unwrap();
+        exit(1);
+    }
+}